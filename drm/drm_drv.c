@@ -51,6 +51,7 @@
 #endif
 #include <linux/slab.h>
 #include <linux/export.h>
+#include <linux/rcupdate.h>
 #include <drm/drmP.h>
 #include <drm/drm_core.h>
 
@@ -329,6 +330,9 @@ static void __exit drm_core_exit(void)
 #elif __FreeBSD__
 	drm_global_release();
 
+	/* Deferred hash table and TTM ref object frees. */
+	rcu_barrier();
+
 	mutex_destroy(&drm_global_mutex);
 #endif
 }
@@ -270,6 +270,14 @@ drm_gem_handle_delete(struct drm_file *filp, u32 handle)
 	}
 	dev = obj->dev;
 
+	/*
+	 * Let the driver drop any lookup cache entry for the handle while
+	 * it is still in the idr, so that no cached lookup can return the
+	 * object once the handle number is free to be reused.
+	 */
+	if (dev->driver->gem_close_object)
+		dev->driver->gem_close_object(obj, filp);
+
 	/* Release reference and decrement refcount. */
 	idr_remove(&filp->object_idr, handle);
 	spin_unlock(&filp->table_lock);
@@ -278,8 +286,6 @@ drm_gem_handle_delete(struct drm_file *filp, u32 handle)
 	drm_gem_remove_prime_handles(obj, filp);
 #endif
 
-	if (dev->driver->gem_close_object)
-		dev->driver->gem_close_object(obj, filp);
 	drm_gem_object_handle_unreference_unlocked(obj);
 
 	return 0;
@@ -28,6 +28,13 @@
 /*
  * Simple open hash tab implementation.
  *
+ * The table grows and shrinks with the number of items. A resize only
+ * allocates the new bucket array; the items are then migrated a few old
+ * buckets at a time by the following insertions and removals, so no single
+ * caller pays for a full rehash. Until the migration is done, keys hashing
+ * to an old bucket that hasn't been migrated yet still live in the old
+ * table.
+ *
  * Authors:
  * Thomas Hellström <thomas-at-tungstengraphics-dot-com>
  */
@@ -37,17 +44,77 @@
 #include <linux/hash.h>
 #include <linux/slab.h>
 #include <linux/export.h>
+#include <linux/rculist.h>
 
-int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
+/* Grow above two items per bucket, shrink below one per eight buckets. */
+#define DRM_HT_GROW_LOAD	2
+#define DRM_HT_SHRINK_LOAD	8
+#define DRM_HT_MAX_ORDER	20
+/* Old buckets migrated by each insertion or removal during a resize. */
+#define DRM_HT_MIGRATE_STEP	4
+
+/*
+ * Bucket arrays carry their order and are freed after an RCU grace period,
+ * so that lockless readers always index an array with its own size.
+ */
+struct drm_ht_table {
+	struct rcu_head rcu;
+	u8 order;
+	bool vmalloced;
+	struct hlist_head buckets[];
+};
+
+static inline struct drm_ht_table *drm_ht_table(struct hlist_head *buckets)
 {
-	unsigned int size = 1 << order;
+	return container_of(buckets, struct drm_ht_table, buckets[0]);
+}
 
-	ht->order = order;
-	ht->table = NULL;
-	if (size <= PAGE_SIZE / sizeof(*ht->table))
-		ht->table = kcalloc(size, sizeof(*ht->table), GFP_KERNEL);
+static struct hlist_head *drm_ht_alloc_table(unsigned int order, gfp_t gfp)
+{
+	struct drm_ht_table *table;
+	size_t size = sizeof(*table) +
+		(sizeof(struct hlist_head) << order);
+
+	/* Only creation may sleep; resizes happen under the caller's lock. */
+	if (size <= PAGE_SIZE || gfp != GFP_KERNEL) {
+		table = kzalloc(size, gfp);
+		if (table)
+			table->vmalloced = false;
+	} else {
+		table = vzalloc(size);
+		if (table)
+			table->vmalloced = true;
+	}
+	if (!table)
+		return NULL;
+	table->order = order;
+	return table->buckets;
+}
+
+static void drm_ht_free_table(struct drm_ht_table *table)
+{
+	if (table->vmalloced)
+		vfree(table);
 	else
-		ht->table = vzalloc(size*sizeof(*ht->table));
+		kfree(table);
+}
+
+static void drm_ht_free_table_rcu(struct rcu_head *rcu)
+{
+	drm_ht_free_table(container_of(rcu, struct drm_ht_table, rcu));
+}
+
+int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
+{
+	ht->order = order;
+	ht->min_order = order;
+	ht->old_table = NULL;
+	ht->old_order = 0;
+	ht->migrate_pos = 0;
+	ht->count = 0;
+	ht->seq = 0;
+	ht->resizes = 0;
+	ht->table = drm_ht_alloc_table(order, GFP_KERNEL);
 	if (!ht->table) {
 		DRM_ERROR("Out of memory for hash table\n");
 		return -ENOMEM;
@@ -56,6 +123,139 @@ int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
 }
 EXPORT_SYMBOL(drm_ht_create);
 
+/*
+ * Bucket currently holding key. Callers serialize with the modifying
+ * functions.
+ */
+static struct hlist_head *drm_ht_bucket(struct drm_open_hash *ht,
+					unsigned long key)
+{
+	unsigned int hashed_key;
+
+	if (ht->old_table) {
+		hashed_key = hash_long(key, ht->old_order);
+		if (hashed_key >= ht->migrate_pos)
+			return &ht->old_table[hashed_key];
+	}
+	hashed_key = hash_long(key, ht->order);
+	return &ht->table[hashed_key];
+}
+
+/*
+ * Lockless readers retry lookups that failed while a resize or a
+ * migration step was in progress, since the item may have been moving
+ * between chains.
+ */
+static inline void drm_ht_write_begin(struct drm_open_hash *ht)
+{
+	WRITE_ONCE(ht->seq, ht->seq + 1);
+	smp_wmb();
+}
+
+static inline void drm_ht_write_end(struct drm_open_hash *ht)
+{
+	smp_wmb();
+	WRITE_ONCE(ht->seq, ht->seq + 1);
+}
+
+static void drm_ht_insert_sorted(struct hlist_head *h_list,
+				 struct drm_hash_item *item)
+{
+	struct drm_hash_item *entry;
+	struct hlist_node *parent = NULL;
+
+	hlist_for_each_entry(entry, h_list, head) {
+		if (entry->key > item->key)
+			break;
+		parent = &entry->head;
+	}
+	if (parent)
+		hlist_add_behind_rcu(&item->head, parent);
+	else
+		hlist_add_head_rcu(&item->head, h_list);
+}
+
+static void drm_ht_finish_migration(struct drm_open_hash *ht)
+{
+	call_rcu(&drm_ht_table(ht->old_table)->rcu, drm_ht_free_table_rcu);
+	ht->old_table = NULL;
+	ht->old_order = 0;
+	ht->migrate_pos = 0;
+}
+
+/*
+ * Move up to nbuckets old buckets to the new table. The moved items are
+ * unlinked and relinked RCU-style; readers racing with this are caught by
+ * the sequence count.
+ */
+static void drm_ht_migrate(struct drm_open_hash *ht, unsigned int nbuckets)
+{
+	struct drm_hash_item *entry;
+	struct hlist_head *h_list;
+	unsigned int old_size;
+
+	if (!ht->old_table)
+		return;
+
+	old_size = 1U << ht->old_order;
+	drm_ht_write_begin(ht);
+	while (nbuckets-- > 0 && ht->migrate_pos < old_size) {
+		h_list = &ht->old_table[ht->migrate_pos];
+		while (!hlist_empty(h_list)) {
+			entry = hlist_entry(h_list->first,
+					    struct drm_hash_item, head);
+			hlist_del_rcu(&entry->head);
+			drm_ht_insert_sorted(&ht->table[hash_long(entry->key,
+								  ht->order)],
+					     entry);
+		}
+		WRITE_ONCE(ht->migrate_pos, ht->migrate_pos + 1);
+	}
+	if (ht->migrate_pos == old_size)
+		drm_ht_finish_migration(ht);
+	drm_ht_write_end(ht);
+}
+
+static void drm_ht_resize(struct drm_open_hash *ht, unsigned int order)
+{
+	struct hlist_head *table;
+
+	/* A pending migration must be done before starting another one. */
+	if (ht->old_table)
+		drm_ht_migrate(ht, 1U << ht->old_order);
+
+	table = drm_ht_alloc_table(order, GFP_ATOMIC);
+	if (!table)
+		return;
+
+	drm_ht_write_begin(ht);
+	ht->old_order = ht->order;
+	ht->migrate_pos = 0;
+	rcu_assign_pointer(ht->old_table, ht->table);
+	ht->order = order;
+	rcu_assign_pointer(ht->table, table);
+	ht->resizes++;
+	drm_ht_write_end(ht);
+}
+
+/*
+ * Called after every insertion and removal: advance a pending migration
+ * and start a new resize if the load factor went out of bounds.
+ */
+static void drm_ht_rehash(struct drm_open_hash *ht)
+{
+	unsigned long size = 1UL << ht->order;
+
+	drm_ht_migrate(ht, DRM_HT_MIGRATE_STEP);
+
+	if (ht->count > size * DRM_HT_GROW_LOAD &&
+	    ht->order < DRM_HT_MAX_ORDER)
+		drm_ht_resize(ht, ht->order + 1);
+	else if (ht->count < size / DRM_HT_SHRINK_LOAD &&
+		 ht->order > ht->min_order)
+		drm_ht_resize(ht, ht->order - 1);
+}
+
 void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key)
 {
 	struct drm_hash_item *entry;
@@ -65,7 +265,7 @@ void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key)
 
 	hashed_key = hash_long(key, ht->order);
 	DRM_DEBUG("Key is 0x%08lx, Hashed key is 0x%08x\n", key, hashed_key);
-	h_list = &ht->table[hashed_key];
+	h_list = drm_ht_bucket(ht, key);
 	hlist_for_each_entry(entry, h_list, head)
 		DRM_DEBUG("count %d, key: 0x%08lx\n", count++, entry->key);
 }
@@ -75,10 +275,8 @@ static struct hlist_node *drm_ht_find_key(struct drm_open_hash *ht,
 {
 	struct drm_hash_item *entry;
 	struct hlist_head *h_list;
-	unsigned int hashed_key;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
+	h_list = drm_ht_bucket(ht, key);
 	hlist_for_each_entry(entry, h_list, head) {
 		if (entry->key == key)
 			return &entry->head;
@@ -88,36 +286,61 @@ static struct hlist_node *drm_ht_find_key(struct drm_open_hash *ht,
 	return NULL;
 }
 
-#ifdef FREEBSD_NOTYET
 static struct hlist_node *drm_ht_find_key_rcu(struct drm_open_hash *ht,
 					      unsigned long key)
 {
 	struct drm_hash_item *entry;
-	struct hlist_head *h_list;
-	unsigned int hashed_key;
+	struct hlist_head *table, *h_list;
+	unsigned int hashed_key, seq;
+
+retry:
+	seq = READ_ONCE(ht->seq);
+	if (seq & 1) {
+		cpu_spinwait();
+		goto retry;
+	}
+	smp_rmb();
+
+	h_list = NULL;
+	table = rcu_dereference(ht->old_table);
+	if (table) {
+		hashed_key = hash_long(key, drm_ht_table(table)->order);
+		if (hashed_key >= READ_ONCE(ht->migrate_pos))
+			h_list = &table[hashed_key];
+	}
+	if (!h_list) {
+		table = rcu_dereference(ht->table);
+		hashed_key = hash_long(key, drm_ht_table(table)->order);
+		h_list = &table[hashed_key];
+	}
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
 	hlist_for_each_entry_rcu(entry, h_list, head) {
 		if (entry->key == key)
 			return &entry->head;
 		if (entry->key > key)
 			break;
 	}
+
+	smp_rmb();
+	if (READ_ONCE(ht->seq) != seq)
+		goto retry;
 	return NULL;
 }
-#endif
 
-int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
+/*
+ * Link item into its sorted chain. With publish, the item is linked with
+ * the RCU list primitives so that concurrent drm_ht_find_item_rcu()
+ * callers see either the old or the new chain, never a half linked one.
+ */
+static int drm_ht_insert_item_common(struct drm_open_hash *ht,
+				     struct drm_hash_item *item, bool publish)
 {
 	struct drm_hash_item *entry;
 	struct hlist_head *h_list;
 	struct hlist_node *parent;
-	unsigned int hashed_key;
 	unsigned long key = item->key;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
+	h_list = drm_ht_bucket(ht, key);
 	parent = NULL;
 	hlist_for_each_entry(entry, h_list, head) {
 		if (entry->key == key)
@@ -127,21 +350,46 @@ int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
 		parent = &entry->head;
 	}
 	if (parent) {
-		hlist_add_after(parent, &item->head);
+		if (publish)
+			hlist_add_behind_rcu(&item->head, parent);
+		else
+			hlist_add_after(parent, &item->head);
 	} else {
-		hlist_add_head(&item->head, h_list);
+		if (publish)
+			hlist_add_head_rcu(&item->head, h_list);
+		else
+			hlist_add_head(&item->head, h_list);
 	}
+	ht->count++;
+	drm_ht_rehash(ht);
 	return 0;
 }
+
+int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
+{
+	return drm_ht_insert_item_common(ht, item, false);
+}
 EXPORT_SYMBOL(drm_ht_insert_item);
 
+/*
+ * Same as drm_ht_insert_item(), but safe against concurrent
+ * drm_ht_find_item_rcu() callers.
+ */
+int drm_ht_insert_item_rcu(struct drm_open_hash *ht, struct drm_hash_item *item)
+{
+	return drm_ht_insert_item_common(ht, item, true);
+}
+EXPORT_SYMBOL(drm_ht_insert_item_rcu);
+
 /*
  * Just insert an item and return any "bits" bit key that hasn't been
  * used before.
  */
-int drm_ht_just_insert_please(struct drm_open_hash *ht, struct drm_hash_item *item,
-			      unsigned long seed, int bits, int shift,
-			      unsigned long add)
+static int drm_ht_just_insert_please_common(struct drm_open_hash *ht,
+					    struct drm_hash_item *item,
+					    unsigned long seed, int bits,
+					    int shift, unsigned long add,
+					    bool publish)
 {
 	int ret;
 	unsigned long mask = (1 << bits) - 1;
@@ -151,7 +399,7 @@ int drm_ht_just_insert_please(struct drm_open_hash *ht, struct drm_hash_item *it
 	first = unshifted_key;
 	do {
 		item->key = (unshifted_key << shift) + add;
-		ret = drm_ht_insert_item(ht, item);
+		ret = drm_ht_insert_item_common(ht, item, publish);
 		if (ret)
 			unshifted_key = (unshifted_key + 1) & mask;
 	} while(ret && (unshifted_key != first));
@@ -162,8 +410,26 @@ int drm_ht_just_insert_please(struct drm_open_hash *ht, struct drm_hash_item *it
 	}
 	return 0;
 }
+
+int drm_ht_just_insert_please(struct drm_open_hash *ht, struct drm_hash_item *item,
+			      unsigned long seed, int bits, int shift,
+			      unsigned long add)
+{
+	return drm_ht_just_insert_please_common(ht, item, seed, bits, shift,
+						add, false);
+}
 EXPORT_SYMBOL(drm_ht_just_insert_please);
 
+int drm_ht_just_insert_please_rcu(struct drm_open_hash *ht,
+				  struct drm_hash_item *item,
+				  unsigned long seed, int bits, int shift,
+				  unsigned long add)
+{
+	return drm_ht_just_insert_please_common(ht, item, seed, bits, shift,
+						add, true);
+}
+EXPORT_SYMBOL(drm_ht_just_insert_please_rcu);
+
 int drm_ht_find_item(struct drm_open_hash *ht, unsigned long key,
 		     struct drm_hash_item **item)
 {
@@ -178,6 +444,25 @@ int drm_ht_find_item(struct drm_open_hash *ht, unsigned long key,
 }
 EXPORT_SYMBOL(drm_ht_find_item);
 
+/*
+ * Lookup that may run concurrently with the _rcu manipulation functions.
+ * The caller must be inside rcu_read_lock(), and must take its reference
+ * on the item before leaving the read section.
+ */
+int drm_ht_find_item_rcu(struct drm_open_hash *ht, unsigned long key,
+			 struct drm_hash_item **item)
+{
+	struct hlist_node *list;
+
+	list = drm_ht_find_key_rcu(ht, key);
+	if (!list)
+		return -EINVAL;
+
+	*item = hlist_entry(list, struct drm_hash_item, head);
+	return 0;
+}
+EXPORT_SYMBOL(drm_ht_find_item_rcu);
+
 int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key)
 {
 	struct hlist_node *list;
@@ -185,6 +470,8 @@ int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key)
 	list = drm_ht_find_key(ht, key);
 	if (list) {
 		hlist_del_init(list);
+		ht->count--;
+		drm_ht_rehash(ht);
 		return 0;
 	}
 	return -EINVAL;
@@ -193,18 +480,86 @@ int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key)
 int drm_ht_remove_item(struct drm_open_hash *ht, struct drm_hash_item *item)
 {
 	hlist_del_init(&item->head);
+	ht->count--;
+	drm_ht_rehash(ht);
 	return 0;
 }
 EXPORT_SYMBOL(drm_ht_remove_item);
 
+/*
+ * The removed item keeps its forward link so that readers currently on it
+ * can continue down the chain. It must not be freed or reinserted before
+ * a grace period has elapsed.
+ */
+int drm_ht_remove_key_rcu(struct drm_open_hash *ht, unsigned long key)
+{
+	struct hlist_node *list;
+
+	list = drm_ht_find_key(ht, key);
+	if (list) {
+		hlist_del_init_rcu(list);
+		ht->count--;
+		drm_ht_rehash(ht);
+		return 0;
+	}
+	return -EINVAL;
+}
+EXPORT_SYMBOL(drm_ht_remove_key_rcu);
+
+int drm_ht_remove_item_rcu(struct drm_open_hash *ht, struct drm_hash_item *item)
+{
+	hlist_del_init_rcu(&item->head);
+	ht->count--;
+	drm_ht_rehash(ht);
+	return 0;
+}
+EXPORT_SYMBOL(drm_ht_remove_item_rcu);
+
 void drm_ht_remove(struct drm_open_hash *ht)
 {
+	if (ht->old_table) {
+		drm_ht_free_table(drm_ht_table(ht->old_table));
+		ht->old_table = NULL;
+	}
 	if (ht->table) {
-		if ((PAGE_SIZE / sizeof(*ht->table)) >> ht->order)
-			kfree(ht->table);
-		else
-			vfree(ht->table);
+		drm_ht_free_table(drm_ht_table(ht->table));
 		ht->table = NULL;
 	}
 }
 EXPORT_SYMBOL(drm_ht_remove);
+
+static void drm_ht_stats_table(struct hlist_head *table, unsigned int size,
+			       struct drm_ht_stats *stats)
+{
+	struct hlist_node *node;
+	unsigned int i, len;
+
+	for (i = 0; i < size; i++) {
+		len = 0;
+		hlist_for_each(node, &table[i])
+			len++;
+		if (len > 0)
+			stats->used++;
+		if (len > stats->max_chain)
+			stats->max_chain = len;
+		stats->chains[min(len, DRM_HT_STATS_CHAINS - 1)]++;
+	}
+}
+
+/*
+ * Collect chain length statistics. Walks every bucket, so only meant for
+ * debugging; the caller serializes with the modifying functions.
+ */
+void drm_ht_get_stats(struct drm_open_hash *ht, struct drm_ht_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->count = ht->count;
+	stats->order = ht->order;
+	stats->resizes = ht->resizes;
+	if (ht->old_table) {
+		stats->migrating = 1;
+		drm_ht_stats_table(ht->old_table, 1U << ht->old_order, stats);
+	}
+	drm_ht_stats_table(ht->table, 1U << ht->order, stats);
+}
+EXPORT_SYMBOL(drm_ht_get_stats);
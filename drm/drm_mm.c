@@ -30,10 +30,12 @@
  * Generic simple memory manager implementation. Intended to be used as a base
  * class implementation for more advanced memory managers.
  *
- * Note that the algorithm used is quite simple and there might be substantial
- * performance gains if a smarter free list is implemented. Currently it is just an
- * unordered stack of free regions. This could easily be improved if an RB-tree
- * is used instead. At least if we expect heavy fragmentation.
+ * Free regions are kept on an unordered MRU stack, and additionally in two
+ * RB-trees: one ordered by hole size, used for best-fit searches, and one
+ * ordered by hole address and augmented with the largest hole size of each
+ * subtree, used for first-fit searches. Both stay logarithmic even under
+ * heavy fragmentation. First fit takes the lowest addressed hole that fits,
+ * not the most recently freed one.
  *
  * Aligned allocations can also see improvement.
  *
@@ -51,6 +53,11 @@
 
 #define MM_UNUSED_TARGET 4
 
+/* Counts holes examined by the searches; hooked by the userspace benchmark. */
+#ifndef DRM_MM_SEARCH_STEP
+#define DRM_MM_SEARCH_STEP() do {} while (0)
+#endif
+
 static struct drm_mm_node *drm_mm_kmalloc(struct drm_mm *mm, int atomic)
 {
 	struct drm_mm_node *child;
@@ -118,6 +125,111 @@ static inline unsigned long drm_mm_hole_node_end(struct drm_mm_node *hole_node)
 	return next_node->start;
 }
 
+static int drm_mm_hole_size_cmp(struct drm_mm_node *a, struct drm_mm_node *b)
+{
+	if (a->hole_size != b->hole_size)
+		return (a->hole_size < b->hole_size ? -1 : 1);
+	if (a->hole_start != b->hole_start)
+		return (a->hole_start < b->hole_start ? -1 : 1);
+	return 0;
+}
+
+static int drm_mm_hole_addr_cmp(struct drm_mm_node *a, struct drm_mm_node *b)
+{
+	if (a->hole_start != b->hole_start)
+		return (a->hole_start < b->hole_start ? -1 : 1);
+	return 0;
+}
+
+static void drm_mm_hole_addr_augment(struct drm_mm_node *node)
+{
+	struct drm_mm_node *child;
+	unsigned long max = node->hole_size;
+
+	child = RB_LEFT(node, hole_addr_rb);
+	if (child != NULL && child->hole_max > max)
+		max = child->hole_max;
+	child = RB_RIGHT(node, hole_addr_rb);
+	if (child != NULL && child->hole_max > max)
+		max = child->hole_max;
+	node->hole_max = max;
+}
+
+static void drm_mm_hole_addr_propagate(struct drm_mm_node *node)
+{
+	for (; node != NULL; node = RB_PARENT(node, hole_addr_rb))
+		drm_mm_hole_addr_augment(node);
+}
+
+RB_GENERATE_STATIC(drm_mm_hole_size, drm_mm_node, hole_size_rb,
+    drm_mm_hole_size_cmp);
+
+/*
+ * The tree code keeps the augmented value of rotated nodes up to date;
+ * drm_mm_hole_tree_insert() and drm_mm_hole_tree_remove() also fix up the
+ * path to the root, since not every version of <sys/tree.h> does.
+ */
+#undef RB_AUGMENT
+#undef RB_AUGMENT_CHECK
+#define RB_AUGMENT(x) drm_mm_hole_addr_augment(x)
+#define RB_AUGMENT_CHECK(x) (drm_mm_hole_addr_augment(x), 1)
+RB_GENERATE_STATIC(drm_mm_hole_addr, drm_mm_node, hole_addr_rb,
+    drm_mm_hole_addr_cmp);
+#undef RB_AUGMENT
+#undef RB_AUGMENT_CHECK
+
+static void drm_mm_hole_tree_insert(struct drm_mm *mm,
+				    struct drm_mm_node *hole_node)
+{
+	hole_node->hole_start = drm_mm_hole_node_start(hole_node);
+	hole_node->hole_size = drm_mm_hole_node_end(hole_node) -
+		hole_node->hole_start;
+	hole_node->hole_max = hole_node->hole_size;
+
+	RB_INSERT(drm_mm_hole_size, &mm->hole_size_rb, hole_node);
+	RB_INSERT(drm_mm_hole_addr, &mm->hole_addr_rb, hole_node);
+	drm_mm_hole_addr_propagate(hole_node);
+}
+
+static void drm_mm_hole_tree_remove(struct drm_mm *mm,
+				    struct drm_mm_node *hole_node)
+{
+	struct drm_mm_node *fixup, *succ;
+
+	RB_REMOVE(drm_mm_hole_size, &mm->hole_size_rb, hole_node);
+
+	/* Find the deepest node whose subtree changes once hole_node is
+	 * unlinked, i.e. where the successor gets spliced out. */
+	if (RB_LEFT(hole_node, hole_addr_rb) != NULL &&
+	    RB_RIGHT(hole_node, hole_addr_rb) != NULL) {
+		succ = RB_RIGHT(hole_node, hole_addr_rb);
+		while (RB_LEFT(succ, hole_addr_rb) != NULL)
+			succ = RB_LEFT(succ, hole_addr_rb);
+		fixup = RB_PARENT(succ, hole_addr_rb);
+		if (fixup == hole_node)
+			fixup = succ;
+	} else
+		fixup = RB_PARENT(hole_node, hole_addr_rb);
+
+	RB_REMOVE(drm_mm_hole_addr, &mm->hole_addr_rb, hole_node);
+	drm_mm_hole_addr_propagate(fixup);
+}
+
+/*
+ * Add a hole to the MRU stack and the search trees.
+ */
+static void drm_mm_hole_add(struct drm_mm *mm, struct drm_mm_node *hole_node)
+{
+	list_add(&hole_node->hole_stack, &mm->hole_stack);
+	drm_mm_hole_tree_insert(mm, hole_node);
+}
+
+static void drm_mm_hole_del(struct drm_mm *mm, struct drm_mm_node *hole_node)
+{
+	list_del(&hole_node->hole_stack);
+	drm_mm_hole_tree_remove(mm, hole_node);
+}
+
 static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 				 struct drm_mm_node *node,
 				 unsigned long size, unsigned alignment,
@@ -140,6 +252,7 @@ static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 			adj_start += alignment - tmp;
 	}
 
+	drm_mm_hole_tree_remove(mm, hole_node);
 	if (adj_start == hole_start) {
 		hole_node->hole_follows = 0;
 		list_del(&hole_node->hole_stack);
@@ -156,9 +269,12 @@ static void drm_mm_insert_helper(struct drm_mm_node *hole_node,
 
 	BUG_ON(node->start + node->size > adj_end);
 
+	if (hole_node->hole_follows)
+		drm_mm_hole_tree_insert(mm, hole_node);
+
 	node->hole_follows = 0;
 	if (node->start + node->size < hole_end) {
-		list_add(&node->hole_stack, &mm->hole_stack);
+		drm_mm_hole_add(mm, node);
 		node->hole_follows = 1;
 	}
 }
@@ -237,6 +353,7 @@ static void drm_mm_insert_helper_range(struct drm_mm_node *hole_node,
 			adj_start += alignment - tmp;
 	}
 
+	drm_mm_hole_tree_remove(mm, hole_node);
 	if (adj_start == hole_start) {
 		hole_node->hole_follows = 0;
 		list_del(&hole_node->hole_stack);
@@ -254,9 +371,12 @@ static void drm_mm_insert_helper_range(struct drm_mm_node *hole_node,
 	BUG_ON(node->start + node->size > adj_end);
 	BUG_ON(node->start + node->size > end);
 
+	if (hole_node->hole_follows)
+		drm_mm_hole_tree_insert(mm, hole_node);
+
 	node->hole_follows = 0;
 	if (node->start + node->size < hole_end) {
-		list_add(&node->hole_stack, &mm->hole_stack);
+		drm_mm_hole_add(mm, node);
 		node->hole_follows = 1;
 	}
 }
@@ -331,7 +451,7 @@ void drm_mm_remove_node(struct drm_mm_node *node)
 	if (node->hole_follows) {
 		BUG_ON(drm_mm_hole_node_start(node)
 				== drm_mm_hole_node_end(node));
-		list_del(&node->hole_stack);
+		drm_mm_hole_del(mm, node);
 	} else
 		BUG_ON(drm_mm_hole_node_start(node)
 				!= drm_mm_hole_node_end(node));
@@ -339,11 +459,15 @@ void drm_mm_remove_node(struct drm_mm_node *node)
 	if (!prev_node->hole_follows) {
 		prev_node->hole_follows = 1;
 		list_add(&prev_node->hole_stack, &mm->hole_stack);
-	} else
+	} else {
 		list_move(&prev_node->hole_stack, &mm->hole_stack);
+		drm_mm_hole_tree_remove(mm, prev_node);
+	}
 
 	list_del(&node->node_list);
 	node->allocated = 0;
+
+	drm_mm_hole_tree_insert(mm, prev_node);
 }
 EXPORT_SYMBOL(drm_mm_remove_node);
 
@@ -384,45 +508,115 @@ static int check_free_hole(unsigned long start, unsigned long end,
 	return end >= start + size;
 }
 
-struct drm_mm_node *drm_mm_search_free_generic(const struct drm_mm *mm,
-					       unsigned long size,
-					       unsigned alignment,
-					       unsigned long color,
-					       bool best_match)
+static int drm_mm_hole_fits(const struct drm_mm *mm,
+			    struct drm_mm_node *entry,
+			    unsigned long size, unsigned alignment,
+			    unsigned long color,
+			    unsigned long start, unsigned long end)
 {
-	struct drm_mm_node *entry;
-	struct drm_mm_node *best;
-	unsigned long best_size;
+	unsigned long adj_start = entry->hole_start < start ?
+		start : entry->hole_start;
+	unsigned long adj_end = entry->hole_start + entry->hole_size > end ?
+		end : entry->hole_start + entry->hole_size;
 
-	BUG_ON(mm->scanned_blocks);
+	BUG_ON(!entry->hole_follows);
+	DRM_MM_SEARCH_STEP();
 
-	best = NULL;
-	best_size = ~0UL;
+	if (adj_end <= adj_start)
+		return 0;
 
-	list_for_each_entry(entry, &mm->hole_stack, hole_stack) {
-		unsigned long adj_start = drm_mm_hole_node_start(entry);
-		unsigned long adj_end = drm_mm_hole_node_end(entry);
+	if (mm->color_adjust) {
+		mm->color_adjust(entry, color, &adj_start, &adj_end);
+		if (adj_end <= adj_start)
+			return 0;
+	}
 
-		if (mm->color_adjust) {
-			mm->color_adjust(entry, color, &adj_start, &adj_end);
-			if (adj_end <= adj_start)
-				continue;
-		}
+	return check_free_hole(adj_start, adj_end, size, alignment);
+}
 
-		BUG_ON(!entry->hole_follows);
-		if (!check_free_hole(adj_start, adj_end, size, alignment))
-			continue;
+/*
+ * Walk the holes in the size tree starting at the smallest one that could
+ * hold size bytes. The first hole that passes the alignment, color and
+ * range checks is the best fit.
+ */
+static struct drm_mm_node *drm_mm_search_best_fit(const struct drm_mm *mm,
+						  unsigned long size,
+						  unsigned alignment,
+						  unsigned long color,
+						  unsigned long start,
+						  unsigned long end)
+{
+	struct drm_mm_node key, *entry;
 
-		if (!best_match)
+	key.hole_size = size;
+	key.hole_start = 0;
+
+	for (entry = RB_NFIND(drm_mm_hole_size,
+	    __DECONST(struct drm_mm_hole_size *, &mm->hole_size_rb), &key);
+	     entry != NULL;
+	     entry = RB_NEXT(drm_mm_hole_size, NULL, entry)) {
+		if (drm_mm_hole_fits(mm, entry, size, alignment, color,
+				     start, end))
 			return entry;
+	}
 
-		if (entry->size < best_size) {
-			best = entry;
-			best_size = entry->size;
+	return NULL;
+}
+
+/*
+ * Find the lowest addressed hole intersecting [start, end) that fits.
+ * Subtrees whose largest hole is too small are skipped, as are subtrees
+ * lying entirely outside the range: holes are disjoint, so every hole left
+ * of entry ends before entry's hole starts.
+ */
+static struct drm_mm_node *drm_mm_search_first_fit(const struct drm_mm *mm,
+						   struct drm_mm_node *entry,
+						   unsigned long size,
+						   unsigned alignment,
+						   unsigned long color,
+						   unsigned long start,
+						   unsigned long end)
+{
+	struct drm_mm_node *found;
+
+	while (entry != NULL && entry->hole_max >= size) {
+		DRM_MM_SEARCH_STEP();
+		if (entry->hole_start > start) {
+			found = drm_mm_search_first_fit(mm,
+			    RB_LEFT(entry, hole_addr_rb), size, alignment,
+			    color, start, end);
+			if (found != NULL)
+				return found;
 		}
+
+		if (entry->hole_start >= end)
+			break;
+
+		if (entry->hole_size >= size &&
+		    drm_mm_hole_fits(mm, entry, size, alignment, color,
+				     start, end))
+			return entry;
+
+		entry = RB_RIGHT(entry, hole_addr_rb);
 	}
 
-	return best;
+	return NULL;
+}
+
+struct drm_mm_node *drm_mm_search_free_generic(const struct drm_mm *mm,
+					       unsigned long size,
+					       unsigned alignment,
+					       unsigned long color,
+					       bool best_match)
+{
+	BUG_ON(mm->scanned_blocks);
+
+	if (best_match)
+		return drm_mm_search_best_fit(mm, size, alignment, color,
+					      0, ~0UL);
+
+	return drm_mm_search_first_fit(mm, RB_ROOT(&mm->hole_addr_rb),
+				       size, alignment, color, 0, ~0UL);
 }
 EXPORT_SYMBOL(drm_mm_search_free_generic);
 
@@ -434,42 +628,18 @@ struct drm_mm_node *drm_mm_search_free_in_range_generic(const struct drm_mm *mm,
 							unsigned long end,
 							bool best_match)
 {
-	struct drm_mm_node *entry;
-	struct drm_mm_node *best;
-	unsigned long best_size;
-
 	BUG_ON(mm->scanned_blocks);
 
-	best = NULL;
-	best_size = ~0UL;
-
-	list_for_each_entry(entry, &mm->hole_stack, hole_stack) {
-		unsigned long adj_start = drm_mm_hole_node_start(entry) < start ?
-			start : drm_mm_hole_node_start(entry);
-		unsigned long adj_end = drm_mm_hole_node_end(entry) > end ?
-			end : drm_mm_hole_node_end(entry);
-
-		BUG_ON(!entry->hole_follows);
-
-		if (mm->color_adjust) {
-			mm->color_adjust(entry, color, &adj_start, &adj_end);
-			if (adj_end <= adj_start)
-				continue;
-		}
-
-		if (!check_free_hole(adj_start, adj_end, size, alignment))
-			continue;
-
-		if (!best_match)
-			return entry;
+	if (end <= start || end - start < size)
+		return NULL;
 
-		if (entry->size < best_size) {
-			best = entry;
-			best_size = entry->size;
-		}
-	}
+	/* Holes outside the range are passed over by drm_mm_hole_fits(). */
+	if (best_match)
+		return drm_mm_search_best_fit(mm, size, alignment, color,
+					      start, end);
 
-	return best;
+	return drm_mm_search_first_fit(mm, RB_ROOT(&mm->hole_addr_rb),
+				       size, alignment, color, start, end);
 }
 EXPORT_SYMBOL(drm_mm_search_free_in_range_generic);
 
@@ -478,6 +648,9 @@ EXPORT_SYMBOL(drm_mm_search_free_in_range_generic);
  */
 void drm_mm_replace_node(struct drm_mm_node *old, struct drm_mm_node *new)
 {
+	if (old->hole_follows)
+		drm_mm_hole_tree_remove(old->mm, old);
+
 	list_replace(&old->node_list, &new->node_list);
 	list_replace(&old->hole_stack, &new->hole_stack);
 	new->hole_follows = old->hole_follows;
@@ -486,6 +659,9 @@ void drm_mm_replace_node(struct drm_mm_node *old, struct drm_mm_node *new)
 	new->size = old->size;
 	new->color = old->color;
 
+	if (new->hole_follows)
+		drm_mm_hole_tree_insert(new->mm, new);
+
 	old->allocated = 0;
 	new->allocated = 1;
 }
@@ -644,6 +820,8 @@ EXPORT_SYMBOL(drm_mm_clean);
 int drm_mm_init(struct drm_mm * mm, unsigned long start, unsigned long size)
 {
 	INIT_LIST_HEAD(&mm->hole_stack);
+	RB_INIT(&mm->hole_size_rb);
+	RB_INIT(&mm->hole_addr_rb);
 	INIT_LIST_HEAD(&mm->unused_nodes);
 	mm->num_unused = 0;
 	mm->scanned_blocks = 0;
@@ -660,6 +838,7 @@ int drm_mm_init(struct drm_mm * mm, unsigned long start, unsigned long size)
 	mm->head_node.start = start + size;
 	mm->head_node.size = start - mm->head_node.start;
 	list_add_tail(&mm->head_node.hole_stack, &mm->hole_stack);
+	drm_mm_hole_tree_insert(mm, &mm->head_node);
 
 	mm->color_adjust = NULL;
 
@@ -5,6 +5,8 @@
 #include <sys/kdb.h>
 #include <sys/param.h>
 #include <sys/systm.h>
+#include <sys/sbuf.h>
+#include <sys/sysctl.h>
 #include <dev/agp/agpreg.h>
 #include <dev/pci/pcireg.h>
 
@@ -335,29 +337,286 @@ mtrr_del(int handle __unused, unsigned long offset, unsigned long size,
 }
 #endif
 
-void
-drm_clflush_pages(vm_page_t *pages, unsigned long num_pages)
+/*
+ * CPU cache flushing.
+ *
+ * A flush below drm_clflush_wbinvd_threshold bytes is done line by line
+ * through the pmap, which uses clflushopt or clflush; a larger one writes
+ * back and invalidates the caches of all CPUs with wbinvd, whose cost does
+ * not grow with the size of the range.  The threshold is calibrated once
+ * the APs are running by timing both on a scratch buffer, unless it is set
+ * with the hw.drm.clflush.wbinvd_threshold tunable.
+ */
+#define	DRM_CLFLUSH_NSITES		32
+#define	DRM_CLFLUSH_CALIBRATE_SIZE	(1024 * 1024)
+#define	DRM_CLFLUSH_THRESHOLD_DEFAULT	(2 * 1024 * 1024)
+#define	DRM_CLFLUSH_THRESHOLD_MIN	(256 * 1024)
+#define	DRM_CLFLUSH_THRESHOLD_MAX	(64 * 1024 * 1024)
+
+struct drm_clflush_site {
+	char	name[32];
+	u_long	calls;
+	u_long	bytes;
+	u_long	wbinvds;
+	u_long	usecs;
+};
+
+static struct drm_clflush_site drm_clflush_sites[DRM_CLFLUSH_NSITES];
+static int drm_clflush_nsites;
+static struct mtx drm_clflush_site_lock;
+MTX_SYSINIT(drm_clflush_site, &drm_clflush_site_lock, "drmclfl", MTX_DEF);
+
+static u_long drm_clflush_wbinvd_threshold;
+
+static int drm_clflush_sites_sysctl(SYSCTL_HANDLER_ARGS);
+
+static SYSCTL_NODE(_hw_drm, OID_AUTO, clflush, CTLFLAG_RD, NULL,
+    "CPU cache flushing");
+SYSCTL_ULONG(_hw_drm_clflush, OID_AUTO, wbinvd_threshold, CTLFLAG_RWTUN,
+    &drm_clflush_wbinvd_threshold, 0,
+    "Flushes of at least this many bytes use wbinvd (0 calibrates)");
+SYSCTL_PROC(_hw_drm_clflush, OID_AUTO, sites,
+    CTLTYPE_STRING | CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, 0,
+    drm_clflush_sites_sysctl, "A", "Flushed bytes and time per call site");
+
+/*
+ * Sites live here rather than in the caller, so the names are copied and
+ * the statistics survive the unload of the module that flushed.
+ */
+struct drm_clflush_site *
+drm_clflush_site_get(const char *name)
+{
+	struct drm_clflush_site *site;
+	int i;
+
+	site = NULL;
+	mtx_lock(&drm_clflush_site_lock);
+	for (i = 0; i < drm_clflush_nsites; i++) {
+		if (strncmp(drm_clflush_sites[i].name, name,
+		    sizeof(drm_clflush_sites[i].name)) == 0) {
+			site = &drm_clflush_sites[i];
+			break;
+		}
+	}
+	if (site == NULL && drm_clflush_nsites < DRM_CLFLUSH_NSITES) {
+		site = &drm_clflush_sites[drm_clflush_nsites];
+		strlcpy(site->name, name, sizeof(site->name));
+		drm_clflush_nsites++;
+	}
+	mtx_unlock(&drm_clflush_site_lock);
+	return (site);
+}
+
+static void
+drm_clflush_account(struct drm_clflush_site *site, u_long bytes, bool all,
+    sbintime_t start)
+{
+
+	if (site == NULL)
+		return;
+	atomic_add_long(&site->calls, 1);
+	atomic_add_long(&site->bytes, bytes);
+	if (all)
+		atomic_add_long(&site->wbinvds, 1);
+	atomic_add_long(&site->usecs, sbttous(sbinuptime() - start));
+}
+
+static int
+drm_clflush_sites_sysctl(SYSCTL_HANDLER_ARGS)
 {
+	struct drm_clflush_site *site;
+	struct sbuf sb;
+	int error, i, n;
+
+	error = sysctl_wire_old_buffer(req, 0);
+	if (error != 0)
+		return (error);
+	sbuf_new_for_sysctl(&sb, NULL, 128, req);
+	sbuf_printf(&sb, "\n%-32s %10s %14s %8s %12s\n", "site", "calls",
+	    "bytes", "wbinvd", "usecs");
+	mtx_lock(&drm_clflush_site_lock);
+	n = drm_clflush_nsites;
+	mtx_unlock(&drm_clflush_site_lock);
+	for (i = 0; i < n; i++) {
+		site = &drm_clflush_sites[i];
+		sbuf_printf(&sb, "%-32s %10lu %14lu %8lu %12lu\n", site->name,
+		    site->calls, site->bytes, site->wbinvds, site->usecs);
+	}
+	error = sbuf_finish(&sb);
+	sbuf_delete(&sb);
+	return (error);
+}
 
+static void
+drm_clflush_calibrate(void *arg __unused)
+{
 #if defined(__i386__) || defined(__amd64__)
-	pmap_invalidate_cache_pages(pages, num_pages);
+	sbintime_t line, all, t;
+	uint64_t threshold;
+	char *buf;
+	int i;
+
+	if (drm_clflush_wbinvd_threshold != 0)
+		return;
+	drm_clflush_wbinvd_threshold = DRM_CLFLUSH_THRESHOLD_DEFAULT;
+
+	/* Below the pmap's own wbinvd cutoff, so this is flushed by line. */
+	buf = malloc(DRM_CLFLUSH_CALIBRATE_SIZE, DRM_MEM_DRIVER, M_NOWAIT);
+	if (buf == NULL)
+		return;
+	line = all = SBT_MAX;
+	for (i = 0; i < 3; i++) {
+		memset(buf, i, DRM_CLFLUSH_CALIBRATE_SIZE);
+		t = sbinuptime();
+		pmap_invalidate_cache_range((vm_offset_t)buf,
+		    (vm_offset_t)buf + DRM_CLFLUSH_CALIBRATE_SIZE, TRUE);
+		line = MIN(line, sbinuptime() - t);
+
+		memset(buf, i, DRM_CLFLUSH_CALIBRATE_SIZE);
+		t = sbinuptime();
+		pmap_invalidate_cache();
+		all = MIN(all, sbinuptime() - t);
+	}
+	free(buf, DRM_MEM_DRIVER);
+	if (line <= 0)
+		return;
+
+	threshold = (uint64_t)DRM_CLFLUSH_CALIBRATE_SIZE * all / line;
+	threshold = MAX(threshold, DRM_CLFLUSH_THRESHOLD_MIN);
+	threshold = MIN(threshold, DRM_CLFLUSH_THRESHOLD_MAX);
+	drm_clflush_wbinvd_threshold = threshold;
+	if (bootverbose)
+		printf("drm: clflush %ju us/MB, wbinvd %ju us, "
+		    "wbinvd threshold %lu bytes\n", (uintmax_t)sbttous(line),
+		    (uintmax_t)sbttous(all), drm_clflush_wbinvd_threshold);
+#endif
+}
+SYSINIT(drm_clflush_calibrate, SI_SUB_SMP, SI_ORDER_ANY,
+    drm_clflush_calibrate, NULL);
+
+static bool
+drm_clflush_use_wbinvd(u_long bytes)
+{
+
+	return (bytes >= drm_clflush_wbinvd_threshold &&
+	    drm_clflush_wbinvd_threshold != 0);
+}
+
+void
+drm_clflush_pages_site(struct drm_clflush_site *site, vm_page_t *pages,
+    unsigned long num_pages)
+{
+#if defined(__i386__) || defined(__amd64__)
+	sbintime_t start;
+	bool all;
+
+	start = sbinuptime();
+	all = drm_clflush_use_wbinvd(num_pages * PAGE_SIZE);
+	if (all)
+		pmap_invalidate_cache();
+	else
+		pmap_invalidate_cache_pages(pages, num_pages);
+	drm_clflush_account(site, num_pages * PAGE_SIZE, all, start);
 #else
 	DRM_ERROR("drm_clflush_pages not implemented on this architecture");
 #endif
 }
 
 void
-drm_clflush_virt_range(char *addr, unsigned long length)
+drm_clflush_virt_range_site(struct drm_clflush_site *site, char *addr,
+    unsigned long length)
 {
-
 #if defined(__i386__) || defined(__amd64__)
-	pmap_invalidate_cache_range((vm_offset_t)addr,
-	    (vm_offset_t)addr + length, TRUE);
+	sbintime_t start;
+	bool all;
+
+	start = sbinuptime();
+	all = drm_clflush_use_wbinvd(length);
+	if (all)
+		pmap_invalidate_cache();
+	else
+		pmap_invalidate_cache_range((vm_offset_t)addr,
+		    (vm_offset_t)addr + length, TRUE);
+	drm_clflush_account(site, length, all, start);
 #else
 	DRM_ERROR("drm_clflush_virt_range not implemented on this architecture");
 #endif
 }
 
+void
+drm_clflush_batch_init_site(struct drm_clflush_batch *batch,
+    struct drm_clflush_site *site)
+{
+
+	batch->site = site;
+	batch->count = 0;
+	batch->total = 0;
+	batch->all = false;
+}
+
+/* Flush the queued page arrays line by line and empty the queue. */
+static void
+drm_clflush_batch_drain(struct drm_clflush_batch *batch)
+{
+#if defined(__i386__) || defined(__amd64__)
+	sbintime_t start;
+	u_long bytes;
+	int i;
+
+	if (batch->count == 0)
+		return;
+	start = sbinuptime();
+	bytes = 0;
+	for (i = 0; i < batch->count; i++) {
+		pmap_invalidate_cache_pages(batch->ent[i].pages,
+		    batch->ent[i].num_pages);
+		bytes += batch->ent[i].num_pages * PAGE_SIZE;
+	}
+	drm_clflush_account(batch->site, bytes, false, start);
+#else
+	DRM_ERROR("drm_clflush_pages not implemented on this architecture");
+#endif
+	batch->count = 0;
+}
+
+void
+drm_clflush_batch_add(struct drm_clflush_batch *batch, vm_page_t *pages,
+    unsigned long num_pages)
+{
+
+	if (batch->all)
+		return;
+	batch->total += num_pages;
+	if (drm_clflush_use_wbinvd(batch->total * PAGE_SIZE)) {
+		/* One wbinvd at commit covers everything queued so far. */
+		batch->all = true;
+		batch->count = 0;
+		return;
+	}
+	if (batch->count == DRM_CLFLUSH_BATCH)
+		drm_clflush_batch_drain(batch);
+	batch->ent[batch->count].pages = pages;
+	batch->ent[batch->count].num_pages = num_pages;
+	batch->count++;
+}
+
+void
+drm_clflush_batch_commit(struct drm_clflush_batch *batch)
+{
+#if defined(__i386__) || defined(__amd64__)
+	sbintime_t start;
+
+	if (batch->all) {
+		start = sbinuptime();
+		pmap_invalidate_cache();
+		drm_clflush_account(batch->site, batch->total * PAGE_SIZE,
+		    true, start);
+	}
+#endif
+	drm_clflush_batch_drain(batch);
+	drm_clflush_batch_init_site(batch, batch->site);
+}
+
 void
 hex_dump_to_buffer(const void *buf, size_t len, int rowsize, int groupsize,
     char *linebuf, size_t linebuflen, bool ascii __unused)
@@ -36,6 +36,7 @@ static int	   drm_vm_info DRM_SYSCTL_HANDLER_ARGS;
 static int	   drm_clients_info DRM_SYSCTL_HANDLER_ARGS;
 static int	   drm_bufs_info DRM_SYSCTL_HANDLER_ARGS;
 static int	   drm_vblank_info DRM_SYSCTL_HANDLER_ARGS;
+static int	   drm_hashtab_info DRM_SYSCTL_HANDLER_ARGS;
 
 struct drm_sysctl_list {
 	const char *name;
@@ -46,6 +47,7 @@ struct drm_sysctl_list {
 	{"clients", drm_clients_info},
 	{"bufs",    drm_bufs_info},
 	{"vblank",    drm_vblank_info},
+	{"hashtab", drm_hashtab_info},
 };
 #define DRM_SYSCTL_ENTRIES (sizeof(drm_sysctl_list)/sizeof(drm_sysctl_list[0]))
 
@@ -398,3 +400,37 @@ done:
 	SYSCTL_OUT(req, "", -1);
 	return retcode;
 }
+
+static int drm_hashtab_info DRM_SYSCTL_HANDLER_ARGS
+{
+	struct drm_device *dev = arg1;
+	struct drm_gem_mm *mm = dev->mm_private;
+	struct drm_ht_stats stats[2];
+	const char *names[2] = { "map", "gem_offset" };
+	char buf[128];
+	int retcode;
+	int i, j, ntables;
+
+	mutex_lock(&dev->struct_mutex);
+	drm_ht_get_stats(&dev->map_hash, &stats[0]);
+	ntables = 1;
+	if (drm_core_check_feature(dev, DRIVER_GEM) && mm != NULL)
+		drm_ht_get_stats(&mm->offset_hash, &stats[ntables++]);
+	mutex_unlock(&dev->struct_mutex);
+
+	DRM_SYSCTL_PRINT("\ntable       items order used max resizes  "
+	    "chains 0..%d+\n", DRM_HT_STATS_CHAINS - 1);
+	for (i = 0; i < ntables; i++) {
+		DRM_SYSCTL_PRINT("%-10s %6lu %5u %4u %3u %7u%s ",
+		    names[i], stats[i].count, stats[i].order, stats[i].used,
+		    stats[i].max_chain, stats[i].resizes,
+		    stats[i].migrating ? "*" : " ");
+		for (j = 0; j < DRM_HT_STATS_CHAINS; j++)
+			DRM_SYSCTL_PRINT(" %u", stats[i].chains[j]);
+		DRM_SYSCTL_PRINT("\n");
+	}
+
+	SYSCTL_OUT(req, "", 1);
+done:
+	return retcode;
+}
@@ -287,6 +287,18 @@ static int i915_gem_object_info(struct drm_device *dev, struct sbuf *m, void *da
 
 	seq_printf(m, "%zu [%zu] gtt total\n",
 		   dev_priv->mm.gtt_total, dev_priv->mm.mappable_gtt_total);
+	seq_printf(m, "%ju GTT mmap faults mapping %ju pages, "
+		   "%ju faults per MB\n",
+		   (uintmax_t)dev_priv->mm.gtt_faults,
+		   (uintmax_t)dev_priv->mm.gtt_fault_pages,
+		   dev_priv->mm.gtt_fault_pages != 0 ?
+		   (uintmax_t)(dev_priv->mm.gtt_faults * (1024 * 1024 / PAGE_SIZE) /
+		   dev_priv->mm.gtt_fault_pages) : 0);
+	seq_printf(m, "%u PTEs queued for clearing in %d ranges, "
+		   "%ju cleared, %ju rebound first\n",
+		   dev_priv->mm.gtt_clear_entries, dev_priv->mm.gtt_clear_count,
+		   (uintmax_t)dev_priv->mm.gtt_clear_flushed,
+		   (uintmax_t)dev_priv->mm.gtt_clear_overwritten);
 
 	mutex_unlock(&dev->struct_mutex);
 
@@ -440,6 +452,8 @@ static void i915_ring_seqno_info(struct sbuf *m,
 	if (ring->get_seqno) {
 		seq_printf(m, "Current sequence (%s): %d\n",
 			   ring->name, ring->get_seqno(ring, false));
+		seq_printf(m, "Last retired sequence (%s): %d\n",
+			   ring->name, ring->last_retired_seqno);
 	}
 }
 
@@ -2535,6 +2549,44 @@ void i915_debugfs_cleanup(struct drm_minor *minor)
 #endif
 
 #ifdef __FreeBSD__
+static void
+i915_bind_stat_print(struct sbuf *m, const char *name,
+    const struct i915_bind_stat *st)
+{
+
+	seq_printf(m, "%-8s %10ju %12ju %10ju %14ju\n", name,
+	    (uintmax_t)st->binds, (uintmax_t)st->ptes,
+	    (uintmax_t)st->ns / 1000,
+	    st->ns != 0 ? (uintmax_t)(st->ptes * 1000000000 / st->ns) : 0);
+}
+
+static int
+i915_bind_stats(struct drm_device *dev, struct sbuf *m, void *data)
+{
+	drm_i915_private_t *dev_priv = dev->dev_private;
+
+	seq_printf(m, "%-8s %10s %12s %10s %14s\n", "gtt", "binds", "PTEs",
+	    "us", "PTEs/sec");
+	i915_bind_stat_print(m, "global", &dev_priv->mm.ggtt_bind_stat);
+	i915_bind_stat_print(m, "ppgtt", &dev_priv->mm.ppgtt_bind_stat);
+
+	return 0;
+}
+
+static int
+i915_bind_stats_write(struct drm_device *dev, const char *str, void *unused)
+{
+	drm_i915_private_t *dev_priv = dev->dev_private;
+
+	mutex_lock(&dev->struct_mutex);
+	memset(&dev_priv->mm.ggtt_bind_stat, 0,
+	    sizeof(dev_priv->mm.ggtt_bind_stat));
+	memset(&dev_priv->mm.ppgtt_bind_stat, 0,
+	    sizeof(dev_priv->mm.ppgtt_bind_stat));
+	mutex_unlock(&dev->struct_mutex);
+	return (0);
+}
+
 static struct i915_info_sysctl_list {
 	const char *name;
 	int (*ptr)(struct drm_device *dev, struct sbuf *m, void *data);
@@ -2577,6 +2629,7 @@ static struct i915_info_sysctl_list {
 	{"i915_swizzle_info", i915_swizzle_info, NULL, 0},
 	{"i915_ppgtt_info", i915_ppgtt_info, NULL, 0},
 	{"i915_dpio", i915_dpio_info, NULL, 0},
+	{"i915_bind_stats", i915_bind_stats, i915_bind_stats_write, 0},
 };
 
 struct i915_info_sysctl_thunk {
@@ -2689,6 +2742,11 @@ i915_sysctl_init(struct drm_device *dev, struct sysctl_ctx_list *ctx,
 	    CTLFLAG_RW, &i915_intr_pf, 0, NULL);
 	if (oid == NULL)
 		return (-ENOMEM);
+	oid = SYSCTL_ADD_INT(ctx, SYSCTL_CHILDREN(top), OID_AUTO,
+	    "fault_around", CTLFLAG_RW, &i915_fault_around, 0,
+	    "Number of pages mapped by each GTT mmap fault");
+	if (oid == NULL)
+		return (-ENOMEM);
 
 	error = drm_add_busid_modesetting(dev, ctx, top);
 	if (error != 0)
@@ -1013,6 +1013,9 @@ static int i915_getparam(struct drm_device *dev, void *data,
 	case I915_PARAM_HAS_PINNED_BATCHES:
 		value = 1;
 		break;
+	case I915_PARAM_HAS_EXEC_NO_RELOC:
+		value = 1;
+		break;
 	default:
 		DRM_DEBUG_DRIVER("Unknown parameter %d\n",
 				 param->param);
@@ -1513,7 +1516,7 @@ int i915_driver_load(struct drm_device *dev, unsigned long flags)
 {
 	struct drm_i915_private *dev_priv;
 	const struct intel_device_info *info;
-	int ret = 0, mmio_bar, mmio_size;
+	int ret = 0, mmio_bar, mmio_size, i;
 	uint32_t aperture_size;
 
 #ifdef FREEBSD_NOTYET
@@ -1733,6 +1736,8 @@ out_gem_unload:
 	spin_lock_destroy(&dev_priv->error_lock);
 	spin_lock_destroy(&dev_priv->rps.lock);
 	spin_lock_destroy(&dev_priv->dpio_lock);
+	for (i = 0; i < I915_NUM_RINGS; i++)
+		spin_lock_destroy(&dev_priv->ring[i].request_lock);
 
 	mutex_destroy(&dev_priv->rps.hw_lock);
 
@@ -1771,7 +1776,7 @@ free_priv:
 int i915_driver_unload(struct drm_device *dev)
 {
 	struct drm_i915_private *dev_priv = dev->dev_private;
-	int ret;
+	int ret, i;
 
 	intel_gpu_ips_teardown();
 
@@ -1889,6 +1894,8 @@ int i915_driver_unload(struct drm_device *dev)
 	spin_lock_destroy(&dev_priv->error_lock);
 	spin_lock_destroy(&dev_priv->rps.lock);
 	spin_lock_destroy(&dev_priv->dpio_lock);
+	for (i = 0; i < I915_NUM_RINGS; i++)
+		spin_lock_destroy(&dev_priv->ring[i].request_lock);
 
 	mutex_destroy(&dev_priv->rps.hw_lock);
 #endif
@@ -1921,6 +1928,8 @@ int i915_driver_open(struct drm_device *dev, struct drm_file *file)
 
 	idr_init(&file_priv->context_idr);
 
+	i915_gem_execbuffer_init_file(file_priv);
+
 	return 0;
 }
 
@@ -1962,6 +1971,7 @@ void i915_driver_lastclose(struct drm_device * dev)
 void i915_driver_preclose(struct drm_device * dev, struct drm_file *file_priv)
 {
 	i915_gem_context_close(dev, file_priv);
+	i915_gem_execbuffer_release(file_priv);
 	i915_gem_release(dev, file_priv);
 }
 
@@ -1972,6 +1982,7 @@ void i915_driver_postclose(struct drm_device *dev, struct drm_file *file)
 #ifdef FREEBSD_NOTYET
 	kfree(file_priv);
 #else
+	spin_lock_destroy(&file_priv->exec_cache.lock);
 	spin_lock_destroy(&file_priv->mm.lock);
 	free(file_priv, DRM_MEM_FILES);
 #endif
@@ -2026,6 +2037,7 @@ struct drm_ioctl_desc i915_ioctls[] = {
 	DRM_IOCTL_DEF_DRV(I915_GEM_CONTEXT_CREATE, i915_gem_context_create_ioctl, DRM_UNLOCKED),
 	DRM_IOCTL_DEF_DRV(I915_GEM_CONTEXT_DESTROY, i915_gem_context_destroy_ioctl, DRM_UNLOCKED),
 	DRM_IOCTL_DEF_DRV(I915_REG_READ, i915_reg_read_ioctl, DRM_UNLOCKED),
+	DRM_IOCTL_DEF_DRV(I915_GEM_USERPTR, i915_gem_userptr_ioctl, DRM_UNLOCKED),
 };
 
 int i915_max_ioctl = DRM_ARRAY_SIZE(i915_ioctls);
@@ -143,6 +143,27 @@ module_param_named(i915_enable_ppgtt, i915_enable_ppgtt, int, 0600);
 MODULE_PARM_DESC(i915_enable_ppgtt,
 		"Enable PPGTT (default: true)");
 
+int i915_swizzle_simd __read_mostly = -1;
+TUNABLE_INT("drm.i915.swizzle_simd", &i915_swizzle_simd);
+module_param_named(swizzle_simd, i915_swizzle_simd, int, 0400);
+MODULE_PARM_DESC(swizzle_simd,
+		"Limit the bit 17 page swizzle to "
+		"(0=scalar, 1=SSE2, 2=AVX, -1=best the CPU supports [default])");
+
+int i915_evict_policy __read_mostly = 1;
+TUNABLE_INT("drm.i915.evict_policy", &i915_evict_policy);
+module_param_named(evict_policy, i915_evict_policy, int, 0600);
+MODULE_PARM_DESC(evict_policy,
+		"Order of GTT eviction "
+		"(0=list order, 1=objects used once before reused ones [default])");
+
+int i915_fault_around __read_mostly = 16;
+TUNABLE_INT("drm.i915.fault_around", &i915_fault_around);
+module_param_named(fault_around, i915_fault_around, int, 0600);
+MODULE_PARM_DESC(fault_around,
+		"Number of pages mapped by each GTT mmap fault, objects that "
+		"small are mapped whole (default: 16, 1 to disable)");
+
 unsigned int i915_preliminary_hw_support __read_mostly = 0;
 TUNABLE_INT("drm.i915.enable_unsupported", &i915_preliminary_hw_support);
 module_param_named(preliminary_hw_support, i915_preliminary_hw_support, int, 0600);
@@ -1203,6 +1224,7 @@ static struct drm_driver driver = {
 #endif
 	.gem_init_object = i915_gem_init_object,
 	.gem_free_object = i915_gem_free_object,
+	.gem_close_object = i915_gem_close_object,
 #if defined(__linux__)
 	.gem_vm_ops = &i915_gem_vm_ops,
 #elif defined(__FreeBSD__)
@@ -31,6 +31,7 @@
 #define _I915_DRV_H_
 
 #ifdef __FreeBSD__
+#include <sys/seq.h>
 #include <dev/agp/agp_i810.h>
 #include <drm/drm_mm.h>
 #endif
@@ -136,6 +137,9 @@ struct intel_ddi_plls {
 #define I915_GEM_PHYS_OVERLAY_REGS 3
 #define I915_MAX_PHYS_OBJECT (I915_GEM_PHYS_OVERLAY_REGS)
 
+/* Unbound GTT ranges queued for clearing, see i915_gem_gtt_flush_clears() */
+#define I915_GTT_CLEAR_RANGES	32
+
 struct drm_i915_gem_phys_object {
 	int id;
 #ifdef __linux__
@@ -646,6 +650,13 @@ struct intel_l3_parity {
 	struct work_struct error_work;
 };
 
+/* Bind throughput, reported by info.i915_bind_stats */
+struct i915_bind_stat {
+	u64 binds;
+	u64 ptes;
+	u64 ns;
+};
+
 typedef struct drm_i915_private {
 	struct drm_device *dev;
 
@@ -907,6 +918,32 @@ typedef struct drm_i915_private {
 		size_t mappable_gtt_total;
 		size_t object_memory;
 		u32 object_count;
+
+		/** Execbuffer count driving reuse-aware eviction, i915_evict.h */
+		u32 use_clock;
+
+		/**
+		 * Unbound GTT ranges whose PTEs still point at the pages of
+		 * the object last bound there, waiting for a batched clear
+		 * to the scratch page.
+		 */
+		struct i915_gtt_clear {
+			unsigned first_entry;
+			unsigned num_entries;
+		} gtt_clear[I915_GTT_CLEAR_RANGES];
+		int gtt_clear_count;
+		unsigned gtt_clear_entries;
+		/** PTEs cleared from the queue, and rebound before that */
+		u64 gtt_clear_flushed;
+		u64 gtt_clear_overwritten;
+
+		/** PTE writes on bind, to the global GTT and aliasing PPGTT */
+		struct i915_bind_stat ggtt_bind_stat;
+		struct i915_bind_stat ppgtt_bind_stat;
+
+		/** GTT mmap faults and the pages they mapped */
+		u64 gtt_faults;
+		u64 gtt_fault_pages;
 	} mm;
 
 	/* Kernel Modesetting */
@@ -1011,6 +1048,9 @@ struct drm_i915_gem_object_ops {
 	 */
 	int (*get_pages)(struct drm_i915_gem_object *);
 	void (*put_pages)(struct drm_i915_gem_object *);
+	/* Optional, drops whatever else the backing storage holds when the
+	 * object is freed. */
+	void (*release)(struct drm_i915_gem_object *);
 };
 
 struct drm_i915_gem_object {
@@ -1103,6 +1143,8 @@ struct drm_i915_gem_object {
 	unsigned int has_aliasing_ppgtt_mapping:1;
 	unsigned int has_global_gtt_mapping:1;
 	unsigned int has_dma_mapping:1;
+	/** PTEs queued for clearing may still point at our pages */
+	unsigned int gtt_clear_pending:1;
 
 #ifdef __linux__
 	struct sg_table *pages;
@@ -1134,9 +1176,21 @@ struct drm_i915_gem_object {
 	/** Breadcrumb of last rendering to the buffer. */
 	uint32_t last_read_seqno;
 	uint32_t last_write_seqno;
+	/**
+	 * Write sequence of ring and last_read_seqno, so that the busy
+	 * ioctl can read a consistent pair without the struct mutex.  Both
+	 * are still only written with the struct mutex held.
+	 */
+	seq_t active_seq;
 	/** Breadcrumb of last fenced GPU access to the buffer. */
 	uint32_t last_fenced_seqno;
 
+	/** Use clock of the last execbuffer submitting the object, and
+	 * the reuse credit eviction spends on it, see i915_evict.h.
+	 */
+	uint32_t last_use;
+	uint8_t reuse;
+
 	/** Current tiling stride for the object, if it's tiled. */
 	uint32_t stride;
 
@@ -1150,6 +1204,15 @@ struct drm_i915_gem_object {
 	/** for phy allocated objects */
 	struct drm_i915_gem_phys_object *phys_obj;
 
+#ifdef __FreeBSD__
+	/** Address space and range backing a userptr object */
+	struct {
+		struct vmspace *vmspace;
+		vm_offset_t ptr;
+		uid_t uid;	/* charged for the wired pages */
+	} userptr;
+#endif
+
 	/**
 	 * Number of crtcs where this object is currently the fb, but
 	 * will be page flipped away on the next vblank.  When it
@@ -1192,12 +1255,37 @@ struct drm_i915_gem_request {
 	struct list_head client_list;
 };
 
+/*
+ * Per-file cache of handle to object lookups for execbuffer.  Entries are
+ * direct mapped by handle and hold no reference of their own: an entry only
+ * lives as long as the handle it caches, and is dropped by the
+ * gem_close_object hook before the handle leaves the idr.
+ */
+#define I915_EXEC_HANDLE_CACHE_SIZE	256
+
+struct i915_exec_handle_cache_entry {
+	u32 handle;
+	struct drm_i915_gem_object *obj;
+};
+
+struct eb_objects;
+
 struct drm_i915_file_private {
 	struct {
 		spinlock_t lock;
 		struct list_head request_list;
 	} mm;
 	struct idr context_idr;
+	struct {
+		spinlock_t lock;
+		/* Bumped on every invalidation, see eb_lookup_objects(). */
+		u32 generation;
+		bool disabled;
+		struct i915_exec_handle_cache_entry
+		    entries[I915_EXEC_HANDLE_CACHE_SIZE];
+		/* eb table kept around between execbuffer calls */
+		struct eb_objects *eb;
+	} exec_cache;
 };
 
 #define INTEL_INFO(dev)	(((struct drm_i915_private *) (dev)->dev_private)->info)
@@ -1338,6 +1426,9 @@ extern int i915_enable_rc6 __read_mostly;
 extern int i915_enable_fbc __read_mostly;
 extern int i915_enable_hangcheck __read_mostly;
 extern int i915_enable_ppgtt __read_mostly;
+extern int i915_swizzle_simd __read_mostly;
+extern int i915_evict_policy __read_mostly;
+extern int i915_fault_around __read_mostly;
 extern unsigned int i915_preliminary_hw_support __read_mostly;
 
 #ifdef __FreeBSD__
@@ -1432,6 +1523,9 @@ int i915_gem_execbuffer(struct drm_device *dev, void *data,
 			struct drm_file *file_priv);
 int i915_gem_execbuffer2(struct drm_device *dev, void *data,
 			 struct drm_file *file_priv);
+void i915_gem_execbuffer_init_file(struct drm_i915_file_private *file_priv);
+void i915_gem_execbuffer_release(struct drm_file *file);
+void i915_gem_close_object(struct drm_gem_object *obj, struct drm_file *file);
 int i915_gem_pin_ioctl(struct drm_device *dev, void *data,
 		       struct drm_file *file_priv);
 int i915_gem_unpin_ioctl(struct drm_device *dev, void *data,
@@ -1458,6 +1552,8 @@ int i915_gem_get_aperture_ioctl(struct drm_device *dev, void *data,
 				struct drm_file *file_priv);
 int i915_gem_wait_ioctl(struct drm_device *dev, void *data,
 			struct drm_file *file_priv);
+int i915_gem_userptr_ioctl(struct drm_device *dev, void *data,
+			   struct drm_file *file_priv);
 void i915_gem_load(struct drm_device *dev);
 int i915_gem_init_object(struct drm_gem_object *obj);
 void i915_gem_object_init(struct drm_i915_gem_object *obj,
@@ -1556,6 +1652,8 @@ int __must_check i915_gem_check_wedge(struct drm_i915_private *dev_priv,
 
 void i915_gem_reset(struct drm_device *dev);
 void i915_gem_clflush_object(struct drm_i915_gem_object *obj);
+void i915_gem_clflush_object_batch(struct drm_i915_gem_object *obj,
+				   struct drm_clflush_batch *batch);
 int __must_check i915_gem_object_set_domain(struct drm_i915_gem_object *obj,
 					    uint32_t read_domains,
 					    uint32_t write_domain);
@@ -1636,6 +1734,7 @@ int __must_check i915_gem_gtt_prepare_object(struct drm_i915_gem_object *obj);
 void i915_gem_gtt_bind_object(struct drm_i915_gem_object *obj,
 				enum i915_cache_level cache_level);
 void i915_gem_gtt_unbind_object(struct drm_i915_gem_object *obj);
+void i915_gem_gtt_flush_clears(struct drm_device *dev);
 void i915_gem_gtt_finish_object(struct drm_i915_gem_object *obj);
 void i915_gem_init_global_gtt(struct drm_device *dev,
 			      unsigned long start,
@@ -1668,6 +1767,7 @@ void i915_gem_object_do_bit_17_swizzle(struct drm_i915_gem_object *obj);
 void i915_gem_object_save_bit_17_swizzle(struct drm_i915_gem_object *obj);
 void i915_gem_object_do_bit_17_swizzle_page(struct drm_i915_gem_object *obj,
     struct vm_page *m);
+void i915_gem_swizzle_init(void);
 
 /* i915_gem_debug.c */
 void i915_gem_dump_object(struct drm_i915_gem_object *obj, int len,
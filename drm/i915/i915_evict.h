@@ -0,0 +1,60 @@
+/*
+ * Reuse-aware eviction.
+ *
+ * Every execbuffer advances a use clock and stamps the objects it submits
+ * with it.  An object submitted again in a later execbuffer earns reuse
+ * credit, up to I915_EVICT_REUSE_MAX.  The eviction scan passes over an
+ * object holding credit, takes one away and moves it to the tail of the
+ * list, the generalized CLOCK algorithm with the list head as its hand.
+ * Objects used once thus go before the recurring working set, and an
+ * object that stops being used loses its credit after a few scans.
+ * These helpers do not depend on the rest of the driver and are shared
+ * with tools/i915_evict_sim.
+ */
+
+#ifndef _I915_EVICT_H_
+#define	_I915_EVICT_H_
+
+#define	I915_EVICT_LIST		0	/* plain list order */
+#define	I915_EVICT_GCLOCK	1	/* list order with reuse credit */
+#define	I915_EVICT_NPOLICY	2
+
+#define	I915_EVICT_REUSE_MAX	3
+
+/* Advance the use clock, skipping 0, which stamps never used objects. */
+static inline uint32_t
+i915_evict_clock_tick(uint32_t *clock)
+{
+
+	if (++*clock == 0)
+		*clock = 1;
+	return (*clock);
+}
+
+/* Record a use of an object at clock, counted once per submission. */
+static inline void
+i915_evict_note_use(uint32_t *last_use, uint8_t *reuse, uint32_t clock)
+{
+
+	if (*last_use == clock)
+		return;
+	if (*last_use != 0 && *reuse < I915_EVICT_REUSE_MAX)
+		(*reuse)++;
+	*last_use = clock;
+}
+
+/*
+ * Whether the scan should pass over an object this time round.  Passing
+ * over it spends one unit of its credit.
+ */
+static inline bool
+i915_evict_second_chance(uint8_t *reuse)
+{
+
+	if (*reuse == 0)
+		return (false);
+	(*reuse)--;
+	return (true);
+}
+
+#endif /* _I915_EVICT_H_ */
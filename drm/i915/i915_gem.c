@@ -630,6 +630,13 @@ i915_gem_pread_ioctl(struct drm_device *dev, void *data,
 		goto out;
 	}
 #endif /* FREEBSD_WIP */
+#ifdef __FreeBSD__
+	/* Neither do userptr objects, userspace has them mapped already. */
+	if (obj->base.vm_obj == NULL) {
+		ret = -EINVAL;
+		goto out;
+	}
+#endif
 
 	trace_i915_gem_object_pread(obj, args->offset, args->size);
 
@@ -1000,6 +1007,13 @@ i915_gem_pwrite_ioctl(struct drm_device *dev, void *data,
 		goto out;
 	}
 #endif /* FREEBSD_WIP */
+#ifdef __FreeBSD__
+	/* Neither do userptr objects, userspace has them mapped already. */
+	if (obj->base.vm_obj == NULL) {
+		ret = -EINVAL;
+		goto out;
+	}
+#endif
 
 	trace_i915_gem_object_pwrite(obj, args->offset, args->size);
 
@@ -1291,6 +1305,12 @@ i915_gem_object_wait_rendering__nonblocking(struct drm_i915_gem_object *obj,
 	if (seqno == 0)
 		return 0;
 
+	/* Already completed, no need to drop the lock to wait for it. */
+	if (i915_seqno_passed(ring->get_seqno(ring, true), seqno)) {
+		ret = 0;
+		goto retire;
+	}
+
 	ret = i915_gem_check_wedge(dev_priv, true);
 	if (ret)
 		return ret;
@@ -1303,6 +1323,8 @@ i915_gem_object_wait_rendering__nonblocking(struct drm_i915_gem_object *obj,
 	ret = __wait_seqno(ring, seqno, true, NULL);
 	mutex_lock(&dev->struct_mutex);
 
+retire:
+
 	i915_gem_retire_requests_ring(ring);
 
 	/* Manually manage the write flush as we may have not yet
@@ -1450,6 +1472,13 @@ i915_gem_mmap_ioctl(struct drm_device *dev, void *data,
 		return -EINVAL;
 	}
 #endif /* FREEBSD_WIP */
+#ifdef __FreeBSD__
+	/* Nor do userptr objects have a VM object. */
+	if (obj->vm_obj == NULL) {
+		drm_gem_object_unreference_unlocked(obj);
+		return -EINVAL;
+	}
+#endif
 
 #ifdef __linux__
 	addr = vm_mmap(obj->filp, 0, args->size,
@@ -1595,6 +1624,76 @@ out:
 #ifdef __FreeBSD__
 int i915_intr_pf;
 
+/*
+ * Insert and busy the aperture page backing pidx of a bound object, unless
+ * it is already there.  Fails on a page busied by somebody else.
+ */
+static bool
+i915_gem_pager_grab_page(vm_object_t vm_obj, vm_paddr_t base, vm_pindex_t pidx)
+{
+	vm_page_t page;
+
+	VM_OBJECT_ASSERT_WLOCKED(vm_obj);
+	page = vm_page_lookup(vm_obj, pidx);
+	if (page == NULL) {
+		page = PHYS_TO_VM_PAGE(base + IDX_TO_OFF(pidx));
+		if (page == NULL || page->object != NULL ||
+		    vm_page_busied(page))
+			return (false);
+		if (vm_page_insert(page, vm_obj, pidx))
+			return (false);
+		page->valid = VM_PAGE_BITS_ALL;
+	} else if (vm_page_busied(page))
+		return (false);
+	vm_page_xbusy(page);
+	return (true);
+}
+
+/*
+ * Map the neighbours of a faulting page along with it, so that streaming
+ * through a GTT mmap takes one fault and one trip through the struct
+ * mutex per window of i915_fault_around pages instead of per page.  The
+ * window is aligned to its size and objects no larger than it are mapped
+ * whole.  The object is bound and fenced by now, so each neighbour is
+ * simply its page of the aperture.  The pager has to return a contiguous
+ * run of busied pages, the window stops at the first neighbour it cannot
+ * busy.
+ */
+static void
+i915_gem_pager_fault_around(struct drm_i915_gem_object *obj,
+    vm_object_t vm_obj, vm_pindex_t pidx, vm_pindex_t *first,
+    vm_pindex_t *last)
+{
+	drm_i915_private_t *dev_priv = obj->base.dev->dev_private;
+	vm_paddr_t base = dev_priv->mm.gtt_base_addr + obj->gtt_offset;
+	vm_pindex_t start, end, npages, window, i;
+
+	*first = *last = pidx;
+	if (i915_fault_around <= 1)
+		return;
+
+	window = i915_fault_around;
+	npages = OFF_TO_IDX(obj->base.size);
+	if (npages <= window) {
+		start = 0;
+		end = npages;
+	} else {
+		start = rounddown(pidx, window);
+		end = MIN(start + window, npages);
+	}
+
+	for (i = pidx + 1; i < end; i++) {
+		if (!i915_gem_pager_grab_page(vm_obj, base, i))
+			break;
+		*last = i;
+	}
+	for (i = pidx; i > start; i--) {
+		if (!i915_gem_pager_grab_page(vm_obj, base, i - 1))
+			break;
+		*first = i - 1;
+	}
+}
+
 static int
 i915_gem_pager_populate(vm_object_t vm_obj, vm_pindex_t pidx, int fault_type,
     vm_prot_t max_prot, vm_pindex_t *first, vm_pindex_t *last)
@@ -1691,14 +1790,17 @@ have_page:
 	CTR4(KTR_DRM, "fault %p %jx %x phys %x", gem_obj, pidx, fault_type,
 	    page->phys_addr);
 	if (pinned) {
+		i915_gem_pager_fault_around(obj, vm_obj, pidx, first, last);
 		/*
 		 * We may have not pinned the object if the page was
 		 * found by the call to vm_page_lookup().
 		 */
 		i915_gem_object_unpin(obj);
-	}
+	} else
+		*first = *last = pidx;
+	dev_priv->mm.gtt_faults++;
+	dev_priv->mm.gtt_fault_pages += *last - *first + 1;
 	mutex_unlock(&dev->struct_mutex);
-	*first = *last = pidx;
 	return (VM_PAGER_OK);
 
 unpin:
@@ -2058,6 +2160,11 @@ i915_gem_object_truncate(struct drm_i915_gem_object *obj)
 	vm_object_t vm_obj;
 
 	vm_obj = obj->base.vm_obj;
+	if (vm_obj == NULL) {
+		/* userptr, the pages belong to the process */
+		i915_gem_object_free_mmap_offset(obj);
+		return;
+	}
 	VM_OBJECT_WLOCK(vm_obj);
 	vm_object_page_remove(vm_obj, 0, 0, false);
 	VM_OBJECT_WUNLOCK(vm_obj);
@@ -2211,6 +2318,12 @@ i915_gem_object_put_pages(struct drm_i915_gem_object *obj)
 	 * lists early. */
 	list_del(&obj->gtt_list);
 
+	/* Queued GTT clears may still point at these pages. */
+	if (obj->gtt_clear_pending) {
+		i915_gem_gtt_flush_clears(obj->base.dev);
+		obj->gtt_clear_pending = 0;
+	}
+
 	ops->put_pages(obj);
 	obj->pages = NULL;
 
@@ -2447,6 +2560,7 @@ i915_gem_object_move_to_active(struct drm_i915_gem_object *obj,
 	u32 seqno = intel_ring_get_seqno(ring);
 
 	BUG_ON(ring == NULL);
+	seq_write_begin(&obj->active_seq);
 	obj->ring = ring;
 
 	/* Add a reference if we're newly entering the active list. */
@@ -2460,6 +2574,7 @@ i915_gem_object_move_to_active(struct drm_i915_gem_object *obj,
 	list_move_tail(&obj->ring_list, &ring->active_list);
 
 	obj->last_read_seqno = seqno;
+	seq_write_end(&obj->active_seq);
 
 	if (obj->fenced_gpu_access) {
 		obj->last_fenced_seqno = seqno;
@@ -2487,9 +2602,11 @@ i915_gem_object_move_to_inactive(struct drm_i915_gem_object *obj)
 	list_move_tail(&obj->mm_list, &dev_priv->mm.inactive_list);
 
 	list_del_init(&obj->ring_list);
+	seq_write_begin(&obj->active_seq);
 	obj->ring = NULL;
-
 	obj->last_read_seqno = 0;
+	seq_write_end(&obj->active_seq);
+
 	obj->last_write_seqno = 0;
 	obj->base.write_domain = 0;
 
@@ -2596,8 +2713,10 @@ i915_add_request(struct intel_ring_buffer *ring,
 	request->ring = ring;
 	request->tail = request_ring_position;
 	request->emitted_jiffies = jiffies;
+	spin_lock(&ring->request_lock);
 	was_empty = list_empty(&ring->request_list);
 	list_add_tail(&request->list, &ring->request_list);
+	spin_unlock(&ring->request_lock);
 	request->file_priv = NULL;
 
 	if (file) {
@@ -2650,13 +2769,21 @@ i915_gem_request_remove_from_client(struct drm_i915_gem_request *request)
 static void i915_gem_reset_ring_lists(struct drm_i915_private *dev_priv,
 				      struct intel_ring_buffer *ring)
 {
+	struct list_head requests;
+
 	if (ring->dev != NULL)
 		BUG_ON(!mutex_is_locked(&ring->dev->struct_mutex));
 
-	while (!list_empty(&ring->request_list)) {
+	/* Unused rings have no dev, so this path is not profiled. */
+	INIT_LIST_HEAD(&requests);
+	spin_lock(&ring->request_lock);
+	list_splice_init(&ring->request_list, &requests);
+	spin_unlock(&ring->request_lock);
+
+	while (!list_empty(&requests)) {
 		struct drm_i915_gem_request *request;
 
-		request = list_first_entry(&ring->request_list,
+		request = list_first_entry(&requests,
 					   struct drm_i915_gem_request,
 					   list);
 
@@ -2674,6 +2801,9 @@ static void i915_gem_reset_ring_lists(struct drm_i915_private *dev_priv,
 
 		i915_gem_object_move_to_inactive(obj);
 	}
+
+	/* The hardware seqno may go anywhere across the reset. */
+	ring->last_retired_seqno = 0;
 }
 
 static void i915_gem_reset_fences(struct drm_device *dev)
@@ -2723,6 +2853,13 @@ void i915_gem_reset(struct drm_device *dev)
 
 /**
  * This function clears the request list as sequence numbers are passed.
+ *
+ * Both ring->request_list and ring->active_list are kept in seqno order,
+ * requests by i915_add_request() and objects by
+ * i915_gem_object_move_to_active(), so retirement stops at the first
+ * entry the GPU has not passed yet and costs O(retired), not O(active).
+ * Calls that see the same hardware seqno as the previous one return
+ * before looking at either list.
  */
 void
 i915_gem_retire_requests_ring(struct intel_ring_buffer *ring)
@@ -2732,9 +2869,12 @@ i915_gem_retire_requests_ring(struct intel_ring_buffer *ring)
 	if (list_empty(&ring->request_list))
 		return;
 
+	seqno = ring->get_seqno(ring, true);
+	if (seqno == ring->last_retired_seqno)
+		goto out;
+
 	WARN_ON(i915_verify_lists(ring->dev));
 
-	seqno = ring->get_seqno(ring, true);
 	CTR2(KTR_DRM, "retire_request_ring %s %d", ring->name, seqno);
 
 	while (!list_empty(&ring->request_list)) {
@@ -2755,7 +2895,9 @@ i915_gem_retire_requests_ring(struct intel_ring_buffer *ring)
 		 */
 		ring->last_retired_head = request->tail;
 
+		spin_lock(&ring->request_lock);
 		list_del(&request->list);
+		spin_unlock(&ring->request_lock);
 		i915_gem_request_remove_from_client(request);
 		kfree(request);
 	}
@@ -2776,13 +2918,15 @@ i915_gem_retire_requests_ring(struct intel_ring_buffer *ring)
 		i915_gem_object_move_to_inactive(obj);
 	}
 
+	ring->last_retired_seqno = seqno;
+	WARN_ON(i915_verify_lists(ring->dev));
+
+out:
 	if (unlikely(ring->trace_irq_seqno &&
 		     i915_seqno_passed(seqno, ring->trace_irq_seqno))) {
 		ring->irq_put(ring);
 		ring->trace_irq_seqno = 0;
 	}
-
-	WARN_ON(i915_verify_lists(ring->dev));
 }
 
 void
@@ -2834,8 +2978,10 @@ i915_gem_retire_work_handler(struct work_struct *work)
 	if (!dev_priv->mm.suspended && !idle)
 		queue_delayed_work(dev_priv->wq, &dev_priv->mm.retire_work,
 				   round_jiffies_up_relative(HZ));
-	if (idle)
+	if (idle) {
+		i915_gem_gtt_flush_clears(dev);
 		intel_mark_idle(dev);
+	}
 
 	mutex_unlock(&dev->struct_mutex);
 }
@@ -3596,15 +3742,15 @@ i915_gem_object_bind_to_gtt(struct drm_i915_gem_object *obj,
 	return 0;
 }
 
-void
-i915_gem_clflush_object(struct drm_i915_gem_object *obj)
+static bool
+i915_gem_object_needs_clflush(struct drm_i915_gem_object *obj)
 {
 	/* If we don't have a page list set up, then we're not pinned
 	 * to GPU, and we can ignore the cache flush because it'll happen
 	 * again at bind time.
 	 */
 	if (obj->pages == NULL)
-		return;
+		return false;
 
 	/* If the GPU is snooping the contents of the CPU cache,
 	 * we do not need to manually clear the CPU cache lines.  However,
@@ -3615,6 +3761,15 @@ i915_gem_clflush_object(struct drm_i915_gem_object *obj)
 	 * tracking.
 	 */
 	if (obj->cache_level != I915_CACHE_NONE)
+		return false;
+
+	return true;
+}
+
+void
+i915_gem_clflush_object(struct drm_i915_gem_object *obj)
+{
+	if (!i915_gem_object_needs_clflush(obj))
 		return;
 
 	trace_i915_gem_object_clflush(obj);
@@ -3622,6 +3777,23 @@ i915_gem_clflush_object(struct drm_i915_gem_object *obj)
 	drm_clflush_pages(obj->pages, obj->base.size / PAGE_SIZE);
 }
 
+/**
+ * Queues the flush of the object's pages on @batch instead of flushing
+ * them right away; the pages are flushed by drm_clflush_batch_commit(),
+ * with a single wbinvd if the batch grew large enough.
+ */
+void
+i915_gem_clflush_object_batch(struct drm_i915_gem_object *obj,
+			      struct drm_clflush_batch *batch)
+{
+	if (!i915_gem_object_needs_clflush(obj))
+		return;
+
+	trace_i915_gem_object_clflush(obj);
+
+	drm_clflush_batch_add(batch, obj->pages, obj->base.size / PAGE_SIZE);
+}
+
 /** Flushes the GTT write domain for the object if it's dirty. */
 static void
 i915_gem_object_flush_gtt_write_domain(struct drm_i915_gem_object *obj)
@@ -4174,6 +4346,46 @@ unlock:
 	return ret;
 }
 
+/**
+ * Answers a busy query from the published seqnos, without the struct mutex.
+ *
+ * The object's ring and last read seqno are read as a pair under its
+ * active_seq and compared with the seqno the ring last wrote to its status
+ * page.  Only an object waiting on the ring's outstanding lazy request
+ * needs the lock, to emit that request so the object eventually idles;
+ * false is returned for it and the caller takes the slow path.
+ */
+static bool
+i915_gem_object_busy_unlocked(struct drm_i915_gem_object *obj, u32 *busy)
+{
+	struct intel_ring_buffer *ring;
+	u32 seqno;
+	seq_t seq;
+
+	for (;;) {
+		seq = seq_read(&obj->active_seq);
+		ring = obj->ring;
+		seqno = obj->last_read_seqno;
+		if (seq_consistent(&obj->active_seq, seq))
+			break;
+		cpu_spinwait();
+	}
+
+	/* Inactive, or finished on the GPU and only waiting to be retired. */
+	if (ring == NULL ||
+	    i915_seqno_passed(ring->get_seqno(ring, true), seqno)) {
+		*busy = 0;
+		return true;
+	}
+
+	if (seqno == atomic_load_acq_32(&ring->outstanding_lazy_request))
+		return false;
+
+	BUILD_BUG_ON(I915_NUM_RINGS > 16);
+	*busy = 1 | intel_ring_flag(ring) << 16;
+	return true;
+}
+
 int
 i915_gem_busy_ioctl(struct drm_device *dev, void *data,
 		    struct drm_file *file)
@@ -4182,14 +4394,19 @@ i915_gem_busy_ioctl(struct drm_device *dev, void *data,
 	struct drm_i915_gem_object *obj;
 	int ret;
 
+	obj = to_intel_bo(drm_gem_object_lookup(dev, file, args->handle));
+	if (&obj->base == NULL)
+		return -ENOENT;
+
+	if (i915_gem_object_busy_unlocked(obj, &args->busy)) {
+		drm_gem_object_unreference_unlocked(&obj->base);
+		return 0;
+	}
+
 	ret = i915_mutex_lock_interruptible(dev);
-	if (ret)
+	if (ret) {
+		drm_gem_object_unreference_unlocked(&obj->base);
 		return ret;
-
-	obj = to_intel_bo(drm_gem_object_lookup(dev, file, args->handle));
-	if (&obj->base == NULL) {
-		ret = -ENOENT;
-		goto unlock;
 	}
 
 	/* Count all active objects as busy, even if they are currently not used
@@ -4206,7 +4423,6 @@ i915_gem_busy_ioctl(struct drm_device *dev, void *data,
 	}
 
 	drm_gem_object_unreference(&obj->base);
-unlock:
 	mutex_unlock(&dev->struct_mutex);
 	return ret;
 }
@@ -4380,6 +4596,9 @@ void i915_gem_free_object(struct drm_gem_object *gem_obj)
 		drm_prime_gem_destroy(&obj->base, NULL);
 #endif /* FREEBSD_WIP */
 
+	if (obj->ops->release)
+		obj->ops->release(obj);
+
 	drm_gem_object_release(&obj->base);
 	i915_gem_info_remove_obj(dev_priv, obj->base.size);
 
@@ -4699,6 +4918,7 @@ init_ring_lists(struct intel_ring_buffer *ring)
 {
 	INIT_LIST_HEAD(&ring->active_list);
 	INIT_LIST_HEAD(&ring->request_list);
+	spin_lock_init(&ring->request_lock);
 }
 
 void
@@ -4741,6 +4961,7 @@ i915_gem_load(struct drm_device *dev)
 	i915_gem_reset_fences(dev);
 
 	i915_gem_detect_bit_6_swizzle(dev);
+	i915_gem_swizzle_init();
 	init_waitqueue_head(&dev_priv->pending_flip_queue);
 
 	dev_priv->mm.interruptible = true;
@@ -4904,6 +5125,10 @@ i915_gem_attach_phys_object(struct drm_device *dev,
 
 	if (id > I915_MAX_PHYS_OBJECT)
 		return -EINVAL;
+#ifdef __FreeBSD__
+	if (obj->base.vm_obj == NULL)
+		return -EINVAL;
+#endif
 
 	if (obj->phys_obj) {
 		if (obj->phys_obj->id == id)
@@ -30,6 +30,7 @@
 #include "i915_drv.h"
 #include <drm/i915_drm.h>
 #include "i915_trace.h"
+#include "i915_evict.h"
 
 static bool
 mark_free(struct drm_i915_gem_object *obj, struct list_head *unwind)
@@ -48,7 +49,7 @@ i915_gem_evict_something(struct drm_device *dev, int min_size,
 {
 	drm_i915_private_t *dev_priv = dev->dev_private;
 	struct list_head eviction_list, unwind_list;
-	struct drm_i915_gem_object *obj;
+	struct drm_i915_gem_object *obj, *next, *last;
 	int ret = 0;
 
 	trace_i915_gem_evict(dev, min_size, alignment, mappable);
@@ -86,7 +87,29 @@ i915_gem_evict_something(struct drm_device *dev, int min_size,
 				 min_size, alignment, cache_level);
 
 	/* First see if there is a large enough contiguous idle region... */
+	if (i915_evict_policy == I915_EVICT_GCLOCK) {
+		/* ...made of objects outside the recurring working set.
+		 * Those in it are aged and moved to the tail as the scan
+		 * passes them, so that the next scan starts on the others,
+		 * and are only considered once the others are not enough.
+		 */
+		last = list_entry(dev_priv->mm.inactive_list.prev,
+				  struct drm_i915_gem_object, mm_list);
+		list_for_each_entry_safe(obj, next,
+					 &dev_priv->mm.inactive_list, mm_list) {
+			if (i915_evict_second_chance(&obj->reuse))
+				list_move_tail(&obj->mm_list,
+					       &dev_priv->mm.inactive_list);
+			else if (mark_free(obj, &unwind_list))
+				goto found;
+			if (obj == last)
+				break;
+		}
+	}
 	list_for_each_entry(obj, &dev_priv->mm.inactive_list, mm_list) {
+		/* Already added by the first pass. */
+		if (!list_empty(&obj->exec_list))
+			continue;
 		if (mark_free(obj, &unwind_list))
 			goto found;
 	}
@@ -29,6 +29,7 @@
 #include <drm/drmP.h>
 #include <drm/i915_drm.h>
 #include "i915_drv.h"
+#include "i915_evict.h"
 #include "i915_trace.h"
 #include "intel_drv.h"
 #ifdef __linux__
@@ -43,14 +44,22 @@ struct eb_objects {
 	struct hlist_head buckets[0];
 };
 
-static struct eb_objects *
-eb_create(int size)
+static int
+eb_buckets(int size)
 {
-	struct eb_objects *eb;
 	int count = PAGE_SIZE / sizeof(struct hlist_head) / 2;
 	BUILD_BUG_ON_NOT_POWER_OF_2(PAGE_SIZE / sizeof(struct hlist_head));
 	while (count > size)
 		count >>= 1;
+	return count;
+}
+
+static struct eb_objects *
+eb_create(int size)
+{
+	struct eb_objects *eb;
+	int count = eb_buckets(size);
+
 	eb = kzalloc(count*sizeof(struct hlist_head) +
 		     sizeof(struct eb_objects),
 		     GFP_KERNEL);
@@ -97,6 +106,188 @@ eb_destroy(struct eb_objects *eb)
 	kfree(eb);
 }
 
+/*
+ * Take the file's cached eb table if it is large enough, so that clients
+ * resubmitting the same buffer list do not allocate on every call.  The
+ * table is detached from the file while in use since relocate_slow drops
+ * struct_mutex and another execbuffer on the same file may run meanwhile.
+ */
+static struct eb_objects *
+eb_get(struct drm_file *file, int size)
+{
+	struct drm_i915_file_private *file_priv = file->driver_priv;
+	struct eb_objects *eb;
+
+	spin_lock(&file_priv->exec_cache.lock);
+	eb = file_priv->exec_cache.eb;
+	file_priv->exec_cache.eb = NULL;
+	spin_unlock(&file_priv->exec_cache.lock);
+
+	if (eb != NULL) {
+		if (eb->and + 1 >= eb_buckets(size)) {
+			eb_reset(eb);
+			return eb;
+		}
+		eb_destroy(eb);
+	}
+	return eb_create(size);
+}
+
+static void
+eb_put(struct drm_file *file, struct eb_objects *eb)
+{
+	struct drm_i915_file_private *file_priv = file->driver_priv;
+
+	spin_lock(&file_priv->exec_cache.lock);
+	if (file_priv->exec_cache.eb == NULL &&
+	    !file_priv->exec_cache.disabled) {
+		file_priv->exec_cache.eb = eb;
+		eb = NULL;
+	}
+	spin_unlock(&file_priv->exec_cache.lock);
+
+	if (eb != NULL)
+		eb_destroy(eb);
+}
+
+static struct drm_i915_gem_object *
+eb_lookup_handle(struct drm_device *dev, struct drm_file *file, u32 handle)
+{
+	struct drm_i915_file_private *file_priv = file->driver_priv;
+	struct i915_exec_handle_cache_entry *entry;
+	struct drm_i915_gem_object *obj;
+	u32 generation;
+
+	entry = &file_priv->exec_cache.entries[handle &
+	    (I915_EXEC_HANDLE_CACHE_SIZE - 1)];
+	if (entry->handle == handle && entry->obj != NULL) {
+		drm_gem_object_reference(&entry->obj->base);
+		return entry->obj;
+	}
+
+	/*
+	 * Miss: go through the idr without the cache lock held.  If a
+	 * handle was closed in the meantime the object we found may be
+	 * on its way out, so only remember it if nothing was invalidated.
+	 */
+	generation = file_priv->exec_cache.generation;
+	spin_unlock(&file_priv->exec_cache.lock);
+	obj = to_intel_bo(drm_gem_object_lookup(dev, file, handle));
+	spin_lock(&file_priv->exec_cache.lock);
+	if (&obj->base == NULL)
+		return NULL;
+	if (file_priv->exec_cache.generation == generation &&
+	    !file_priv->exec_cache.disabled) {
+		entry->handle = handle;
+		entry->obj = obj;
+	}
+	return obj;
+}
+
+/*
+ * Resolve the handles of an execbuffer into referenced objects on the
+ * objects list.  Handles are looked up in the per-file cache first, so an
+ * unchanged buffer list costs one lock round trip for the whole batch.
+ */
+static int
+eb_lookup_objects(struct drm_device *dev, struct drm_file *file,
+		  struct drm_i915_gem_exec_object2 *exec, int count,
+		  struct list_head *objects, struct eb_objects *eb)
+{
+	struct drm_i915_file_private *file_priv = file->driver_priv;
+	struct drm_i915_gem_object *obj, *dup = NULL;
+	int i, ret = 0;
+
+	spin_lock(&file_priv->exec_cache.lock);
+	for (i = 0; i < count; i++) {
+		obj = eb_lookup_handle(dev, file, exec[i].handle);
+		if (obj == NULL) {
+			DRM_DEBUG("Invalid object handle %d at index %d\n",
+				   exec[i].handle, i);
+			ret = -ENOENT;
+			break;
+		}
+
+		if (!list_empty(&obj->exec_list)) {
+			DRM_DEBUG("Object %p [handle %d, index %d] appears more than once in object list\n",
+				   obj, exec[i].handle, i);
+			dup = obj;
+			ret = -EINVAL;
+			break;
+		}
+
+		list_add_tail(&obj->exec_list, objects);
+		obj->exec_handle = exec[i].handle;
+		obj->exec_entry = &exec[i];
+		eb_add_object(eb, obj);
+	}
+	spin_unlock(&file_priv->exec_cache.lock);
+
+	/* The extra reference may be the last one if the handle just went. */
+	if (dup != NULL)
+		drm_gem_object_unreference(&dup->base);
+
+	return ret;
+}
+
+void
+i915_gem_execbuffer_init_file(struct drm_i915_file_private *file_priv)
+{
+
+	spin_lock_init(&file_priv->exec_cache.lock);
+}
+
+/*
+ * Called from preclose: the handles are about to be released one by one,
+ * there is no point in invalidating the cache for each of them.
+ */
+void
+i915_gem_execbuffer_release(struct drm_file *file)
+{
+	struct drm_i915_file_private *file_priv = file->driver_priv;
+	struct eb_objects *eb;
+
+	spin_lock(&file_priv->exec_cache.lock);
+	file_priv->exec_cache.disabled = true;
+	file_priv->exec_cache.generation++;
+	memset(file_priv->exec_cache.entries, 0,
+	    sizeof(file_priv->exec_cache.entries));
+	eb = file_priv->exec_cache.eb;
+	file_priv->exec_cache.eb = NULL;
+	spin_unlock(&file_priv->exec_cache.lock);
+
+	if (eb != NULL)
+		eb_destroy(eb);
+}
+
+/*
+ * gem_close_object hook: a handle of this file to obj is going away.  We
+ * are not told which one, and the object may have several handles in the
+ * same file, so drop every cache entry pointing at it.  This runs under
+ * the file's table_lock, before the handle leaves the idr: a cache hit
+ * can never return the object for a closed or reused handle, and a miss
+ * that found it in the idr sees the generation change.
+ */
+void
+i915_gem_close_object(struct drm_gem_object *gem_obj, struct drm_file *file)
+{
+	struct drm_i915_file_private *file_priv = file->driver_priv;
+	struct drm_i915_gem_object *obj = to_intel_bo(gem_obj);
+	int i;
+
+	spin_lock(&file_priv->exec_cache.lock);
+	file_priv->exec_cache.generation++;
+	if (!file_priv->exec_cache.disabled) {
+		for (i = 0; i < I915_EXEC_HANDLE_CACHE_SIZE; i++) {
+			if (file_priv->exec_cache.entries[i].obj == obj) {
+				file_priv->exec_cache.entries[i].handle = 0;
+				file_priv->exec_cache.entries[i].obj = NULL;
+			}
+		}
+	}
+	spin_unlock(&file_priv->exec_cache.lock);
+}
+
 static inline int use_cpu_reloc(struct drm_i915_gem_object *obj)
 {
 	return (obj->base.write_domain == I915_GEM_DOMAIN_CPU ||
@@ -353,7 +544,8 @@ need_reloc_mappable(struct drm_i915_gem_object *obj)
 
 static int
 i915_gem_execbuffer_reserve_object(struct drm_i915_gem_object *obj,
-				   struct intel_ring_buffer *ring)
+				   struct intel_ring_buffer *ring,
+				   bool no_reloc, bool *moved)
 {
 	struct drm_i915_private *dev_priv = obj->base.dev->dev_private;
 	struct drm_i915_gem_exec_object2 *entry = obj->exec_entry;
@@ -394,7 +586,28 @@ i915_gem_execbuffer_reserve_object(struct drm_i915_gem_object *obj,
 		obj->has_aliasing_ppgtt_mapping = 1;
 	}
 
-	entry->offset = obj->gtt_offset;
+	/* Sandybridge PPGTT errata, see i915_gem_execbuffer_relocate_entry(). */
+	if (entry->flags & EXEC_OBJECT_NEEDS_GTT &&
+	    !obj->has_global_gtt_mapping)
+		i915_gem_gtt_bind_object(obj, obj->cache_level);
+
+	/* Sticky across reserve retries, the caller clears it once. */
+	if (entry->offset != obj->gtt_offset) {
+		entry->offset = obj->gtt_offset;
+		*moved = true;
+	}
+	if (!no_reloc)
+		return 0;
+
+	/*
+	 * The relocations, which normally carry the domains, may not be
+	 * read at all.  Assume any GPU read, and take writes from the
+	 * object flags.
+	 */
+	obj->base.pending_read_domains |=
+	    I915_GEM_GPU_DOMAINS & ~I915_GEM_DOMAIN_COMMAND;
+	if (entry->flags & EXEC_OBJECT_WRITE)
+		obj->base.pending_write_domain = I915_GEM_DOMAIN_RENDER;
 	return 0;
 }
 
@@ -420,7 +633,8 @@ i915_gem_execbuffer_unreserve_object(struct drm_i915_gem_object *obj)
 static int
 i915_gem_execbuffer_reserve(struct intel_ring_buffer *ring,
 			    struct drm_file *file,
-			    struct list_head *objects)
+			    struct list_head *objects,
+			    bool no_reloc, bool *moved)
 {
 	struct drm_i915_gem_object *obj;
 	struct list_head ordered_objects;
@@ -488,7 +702,8 @@ i915_gem_execbuffer_reserve(struct intel_ring_buffer *ring,
 			    (need_mappable && !obj->map_and_fenceable))
 				ret = i915_gem_object_unbind(obj);
 			else
-				ret = i915_gem_execbuffer_reserve_object(obj, ring);
+				ret = i915_gem_execbuffer_reserve_object(obj, ring,
+				    no_reloc, moved);
 			if (ret)
 				goto err;
 		}
@@ -498,7 +713,8 @@ i915_gem_execbuffer_reserve(struct intel_ring_buffer *ring,
 			if (obj->gtt_space)
 				continue;
 
-			ret = i915_gem_execbuffer_reserve_object(obj, ring);
+			ret = i915_gem_execbuffer_reserve_object(obj, ring,
+				    no_reloc, moved);
 			if (ret)
 				goto err;
 		}
@@ -523,12 +739,13 @@ i915_gem_execbuffer_relocate_slow(struct drm_device *dev,
 				  struct list_head *objects,
 				  struct eb_objects *eb,
 				  struct drm_i915_gem_exec_object2 *exec,
-				  int count)
+				  int count, bool no_reloc)
 {
 	struct drm_i915_gem_relocation_entry *reloc;
 	struct drm_i915_gem_object *obj;
 	int *reloc_offset;
 	int i, total, ret;
+	bool moved;
 
 	/* We may process another execbuffer during the unlock... */
 	while (!list_empty(objects)) {
@@ -600,23 +817,13 @@ i915_gem_execbuffer_relocate_slow(struct drm_device *dev,
 
 	/* reacquire the objects */
 	eb_reset(eb);
-	for (i = 0; i < count; i++) {
-		obj = to_intel_bo(drm_gem_object_lookup(dev, file,
-							exec[i].handle));
-		if (&obj->base == NULL) {
-			DRM_DEBUG("Invalid object handle %d at index %d\n",
-				   exec[i].handle, i);
-			ret = -ENOENT;
-			goto err;
-		}
-
-		list_add_tail(&obj->exec_list, objects);
-		obj->exec_handle = exec[i].handle;
-		obj->exec_entry = &exec[i];
-		eb_add_object(eb, obj);
-	}
+	ret = eb_lookup_objects(dev, file, exec, count, objects, eb);
+	if (ret)
+		goto err;
 
-	ret = i915_gem_execbuffer_reserve(ring, file, objects);
+	/* Every relocation is applied below, moved or not. */
+	ret = i915_gem_execbuffer_reserve(ring, file, objects, no_reloc,
+	    &moved);
 	if (ret)
 		goto err;
 
@@ -677,23 +884,29 @@ i915_gem_execbuffer_move_to_gpu(struct intel_ring_buffer *ring,
 				struct list_head *objects)
 {
 	struct drm_i915_gem_object *obj;
+	struct drm_clflush_batch clflush;
 	uint32_t flush_domains = 0;
 	uint32_t flips = 0;
 	int ret;
 
+	/* The CPU caches of all objects are flushed together after the
+	 * loop, which is a single wbinvd when there is enough to flush.
+	 */
+	drm_clflush_batch_init(&clflush);
 	list_for_each_entry(obj, objects, exec_list) {
 		ret = i915_gem_object_sync(obj, ring);
 		if (ret)
 			return ret;
 
 		if (obj->base.write_domain & I915_GEM_DOMAIN_CPU)
-			i915_gem_clflush_object(obj);
+			i915_gem_clflush_object_batch(obj, &clflush);
 
 		if (obj->base.pending_write_domain)
 			flips |= atomic_read(&obj->pending_flip);
 
 		flush_domains |= obj->base.write_domain;
 	}
+	drm_clflush_batch_commit(&clflush);
 
 	if (flips) {
 		ret = i915_gem_execbuffer_wait_for_flips(ring, flips);
@@ -721,7 +934,7 @@ i915_gem_check_execbuffer(struct drm_i915_gem_execbuffer2 *exec)
 
 static int
 validate_exec_list(struct drm_i915_gem_exec_object2 *exec,
-		   int count, vm_page_t ***map, int **maplen)
+		   int count, bool hold, vm_page_t ***map, int **maplen)
 {
 	int i;
 	int relocs_total = 0;
@@ -744,9 +957,12 @@ validate_exec_list(struct drm_i915_gem_exec_object2 *exec,
 			return -EINVAL;
 		relocs_total += exec[i].relocation_count;
 
+		if (exec[i].flags & __EXEC_OBJECT_UNKNOWN_FLAGS)
+			return -EINVAL;
+
 		length = exec[i].relocation_count *
 			sizeof(struct drm_i915_gem_relocation_entry);
-		if (length == 0) {
+		if (length == 0 || !hold) {
 			(*map)[i] = NULL;
 			continue;
 		}
@@ -779,12 +995,17 @@ static void
 i915_gem_execbuffer_move_to_active(struct list_head *objects,
 				   struct intel_ring_buffer *ring)
 {
+	struct drm_i915_private *dev_priv = ring->dev->dev_private;
 	struct drm_i915_gem_object *obj;
+	u32 clock;
 
+	clock = i915_evict_clock_tick(&dev_priv->mm.use_clock);
 	list_for_each_entry(obj, objects, exec_list) {
 		u32 old_read = obj->base.read_domains;
 		u32 old_write = obj->base.write_domain;
 
+		i915_evict_note_use(&obj->last_use, &obj->reuse, clock);
+
 		obj->base.read_domains = obj->base.pending_read_domains;
 		obj->base.write_domain = obj->base.pending_write_domain;
 		obj->fenced_gpu_access = obj->pending_fenced_gpu_access;
@@ -855,6 +1076,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 	u32 mask;
 	u32 flags;
 	int ret, mode, i;
+	bool no_reloc, moved;
 	vm_page_t **relocs_ma;
 	int *relocs_len;
 
@@ -863,7 +1085,14 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 		return -EINVAL;
 	}
 
-	ret = validate_exec_list(exec, args->buffer_count,
+	/*
+	 * With NO_RELOC the relocations are usually not read at all, do not
+	 * wire them up front.  Should an object have moved, the atomic copy
+	 * in i915_gem_execbuffer_relocate() faults and relocate_slow takes
+	 * over.
+	 */
+	no_reloc = (args->flags & I915_EXEC_NO_RELOC) != 0;
+	ret = validate_exec_list(exec, args->buffer_count, !no_reloc,
 	    &relocs_ma, &relocs_len);
 	if (ret)
 		goto pre_mutex_err;
@@ -998,7 +1227,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 		goto pre_mutex_err;
 	}
 
-	eb = eb_create(args->buffer_count);
+	eb = eb_get(file, args->buffer_count);
 	if (eb == NULL) {
 		mutex_unlock(&dev->struct_mutex);
 		ret = -ENOMEM;
@@ -1007,31 +1236,10 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 
 	/* Look up object handles */
 	INIT_LIST_HEAD(&objects);
-	for (i = 0; i < args->buffer_count; i++) {
-		struct drm_i915_gem_object *obj;
-
-		obj = to_intel_bo(drm_gem_object_lookup(dev, file,
-							exec[i].handle));
-		if (&obj->base == NULL) {
-			DRM_DEBUG("Invalid object handle %d at index %d\n",
-				   exec[i].handle, i);
-			/* prevent error path from reading uninitialized data */
-			ret = -ENOENT;
-			goto err;
-		}
-
-		if (!list_empty(&obj->exec_list)) {
-			DRM_DEBUG("Object %p [handle %d, index %d] appears more than once in object list\n",
-				   obj, exec[i].handle, i);
-			ret = -EINVAL;
-			goto err;
-		}
-
-		list_add_tail(&obj->exec_list, &objects);
-		obj->exec_handle = exec[i].handle;
-		obj->exec_entry = &exec[i];
-		eb_add_object(eb, obj);
-	}
+	ret = eb_lookup_objects(dev, file, exec, args->buffer_count, &objects,
+	    eb);
+	if (ret)
+		goto err;
 
 	/* take note of the batch buffer before we might reorder the lists */
 	batch_obj = list_entry(objects.prev,
@@ -1039,22 +1247,30 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 			       exec_list);
 
 	/* Move the objects en-masse into the GTT, evicting if necessary. */
-	ret = i915_gem_execbuffer_reserve(ring, file, &objects);
+	moved = false;
+	ret = i915_gem_execbuffer_reserve(ring, file, &objects, no_reloc,
+	    &moved);
 	if (ret)
 		goto err;
 
-	/* The objects are in their final locations, apply the relocations. */
-	ret = i915_gem_execbuffer_relocate(dev, eb, &objects);
-	if (ret) {
-		if (ret == -EFAULT) {
-			ret = i915_gem_execbuffer_relocate_slow(dev, file, ring,
-								&objects, eb,
-								exec,
-								args->buffer_count);
-			BUG_ON(!mutex_is_locked(&dev->struct_mutex));
+	/*
+	 * The objects are in their final locations, apply the relocations.
+	 * With I915_EXEC_NO_RELOC every relocation already holds the offset
+	 * its target was presumed at, so they only need to be looked at when
+	 * one of the objects did not end up there.
+	 */
+	if (!no_reloc || moved) {
+		ret = i915_gem_execbuffer_relocate(dev, eb, &objects);
+		if (ret) {
+			if (ret == -EFAULT) {
+				ret = i915_gem_execbuffer_relocate_slow(dev,
+				    file, ring, &objects, eb, exec,
+				    args->buffer_count, no_reloc);
+				BUG_ON(!mutex_is_locked(&dev->struct_mutex));
+			}
+			if (ret)
+				goto err;
 		}
-		if (ret)
-			goto err;
 	}
 
 	/* Set the pending read domains for the batch buffer to COMMAND */
@@ -1130,7 +1346,7 @@ i915_gem_do_execbuffer(struct drm_device *dev, void *data,
 	i915_gem_execbuffer_retire_commands(dev, file, ring);
 
 err:
-	eb_destroy(eb);
+	eb_put(file, eb);
 	while (!list_empty(&objects)) {
 		struct drm_i915_gem_object *obj;
 
@@ -1217,6 +1433,10 @@ i915_gem_execbuffer(struct drm_device *dev, void *data,
 	exec2.DR4 = args->DR4;
 	exec2.num_cliprects = args->num_cliprects;
 	exec2.cliprects_ptr = args->cliprects_ptr;
+	/*
+	 * Never I915_EXEC_NO_RELOC: the old exec objects have no flags to
+	 * carry EXEC_OBJECT_WRITE.
+	 */
 	exec2.flags = I915_EXEC_RENDER;
 	i915_execbuffer2_set_context_id(exec2, 0);
 
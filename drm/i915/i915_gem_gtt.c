@@ -82,6 +82,14 @@ static inline gtt_pte_t pte_encode(struct drm_device *dev,
 	return pte;
 }
 
+static inline void i915_bind_stat_add(struct i915_bind_stat *st,
+				      sbintime_t start, unsigned ptes)
+{
+	st->binds++;
+	st->ptes += ptes;
+	st->ns += sbttons(sbinuptime() - start);
+}
+
 /* PPGTT support for Sandybdrige/Gen6 and later */
 static void i915_ppgtt_clear_range(struct i915_hw_ppgtt *ppgtt,
 				   unsigned first_entry,
@@ -255,6 +263,7 @@ static void i915_ppgtt_insert_pages(struct i915_hw_ppgtt *ppgtt,
 	unsigned j, last_pte;
 	vm_paddr_t page_addr;
 	struct sf_buf *sf;
+	gtt_pte_t pte_flags;
 #endif
 
 #ifdef __linux__
@@ -289,6 +298,10 @@ static void i915_ppgtt_insert_pages(struct i915_hw_ppgtt *ppgtt,
 		act_pd++;
 	}
 #elif __FreeBSD__
+	/* The cache bits are the same for every page, encode them once. */
+	pte_flags = pte_encode(ppgtt->dev, 0, cache_level);
+
+	/* Each page table is mapped once and filled in a single pass. */
 	while (num_entries) {
 		last_pte = first_pte + num_entries;
 		if (last_pte > I915_PPGTT_PT_ENTRIES)
@@ -300,8 +313,8 @@ static void i915_ppgtt_insert_pages(struct i915_hw_ppgtt *ppgtt,
 
 		for (j = first_pte; j < last_pte; j++) {
 			page_addr = VM_PAGE_TO_PHYS(*pages);
-			pt_vaddr[j] = pte_encode(ppgtt->dev, page_addr,
-						 cache_level);
+			pt_vaddr[j] = GEN6_PTE_ADDR_ENCODE(page_addr) |
+			    pte_flags;
 
 			pages++;
 		}
@@ -326,11 +339,16 @@ void i915_ppgtt_bind_object(struct i915_hw_ppgtt *ppgtt,
 				     obj->gtt_space->start >> PAGE_SHIFT,
 				     cache_level);
 #elif __FreeBSD__
+	struct drm_i915_private *dev_priv = ppgtt->dev->dev_private;
+	sbintime_t start = sbinuptime();
+
 	i915_ppgtt_insert_pages(ppgtt,
 				     obj->pages,
 				     obj->gtt_space->start >> PAGE_SHIFT,
 				     obj->base.size >> PAGE_SHIFT,
 				     cache_level);
+	i915_bind_stat_add(&dev_priv->mm.ppgtt_bind_stat, start,
+			   obj->base.size >> PAGE_SHIFT);
 #endif
 }
 
@@ -427,9 +445,10 @@ static void undo_idling(struct drm_i915_private *dev_priv, bool interruptible)
 }
 
 
-static void i915_ggtt_clear_range(struct drm_device *dev,
-				 unsigned first_entry,
-				 unsigned num_entries)
+/* Point a range of PTEs at the scratch page, without the posting read. */
+static void __i915_ggtt_clear_range(struct drm_device *dev,
+				    unsigned first_entry,
+				    unsigned num_entries)
 {
 	struct drm_i915_private *dev_priv = dev->dev_private;
 	gtt_pte_t scratch_pte;
@@ -450,22 +469,162 @@ static void i915_ggtt_clear_range(struct drm_device *dev,
 	scratch_pte = pte_encode(dev, dev_priv->mm.gtt->scratch_page_dma, I915_CACHE_LLC);
 	for (i = 0; i < num_entries; i++)
 		iowrite32(scratch_pte, &gtt_base[i]);
-	readl(gtt_base);
+}
+
+static void i915_ggtt_clear_range(struct drm_device *dev,
+				 unsigned first_entry,
+				 unsigned num_entries)
+{
+	struct drm_i915_private *dev_priv = dev->dev_private;
+
+	__i915_ggtt_clear_range(dev, first_entry, num_entries);
+	if (INTEL_INFO(dev)->gen >= 6)
+		readl(dev_priv->mm.gtt->gtt + first_entry);
+}
+
+/*
+ * Unbinding an object does not point its PTEs at the scratch page right
+ * away.  The range is queued instead and the queue is cleared as a batch,
+ * with a single posting read, when the GPU goes idle or the queue fills
+ * up.  Most ranges freed by eviction are bound again before that happens;
+ * binding over a queued range drops it from the queue, so those PTEs are
+ * written once instead of twice.
+ *
+ * The drm_mm node is released as soon as the object is unbound, which
+ * only happens once the GPU is done with it.  Until its range is cleared
+ * the PTEs still point at the pages of the object, so the queue is flushed
+ * before an object with queued PTEs gives up its pages.
+ */
+#define I915_GTT_CLEAR_MAX_ENTRIES	16384	/* 64MB of GTT */
+
+static void i915_ggtt_clear_queue(struct drm_device *dev,
+				  unsigned first_entry,
+				  unsigned num_entries)
+{
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	struct i915_gtt_clear *c;
+
+	/* Neighbouring objects are often evicted back to back. */
+	if (dev_priv->mm.gtt_clear_count > 0) {
+		c = &dev_priv->mm.gtt_clear[dev_priv->mm.gtt_clear_count - 1];
+		if (c->first_entry + c->num_entries == first_entry) {
+			c->num_entries += num_entries;
+			goto queued;
+		}
+		if (first_entry + num_entries == c->first_entry) {
+			c->first_entry = first_entry;
+			c->num_entries += num_entries;
+			goto queued;
+		}
+	}
+
+	if (dev_priv->mm.gtt_clear_count == I915_GTT_CLEAR_RANGES)
+		i915_gem_gtt_flush_clears(dev);
+	c = &dev_priv->mm.gtt_clear[dev_priv->mm.gtt_clear_count++];
+	c->first_entry = first_entry;
+	c->num_entries = num_entries;
+queued:
+	dev_priv->mm.gtt_clear_entries += num_entries;
+	if (dev_priv->mm.gtt_clear_entries >= I915_GTT_CLEAR_MAX_ENTRIES)
+		i915_gem_gtt_flush_clears(dev);
+}
+
+/* Drop the part of the queue that a new binding is about to overwrite. */
+static void i915_ggtt_clear_cancel(struct drm_device *dev,
+				   unsigned first_entry,
+				   unsigned num_entries)
+{
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	struct i915_gtt_clear *c, *tail;
+	unsigned end = first_entry + num_entries, c_end, overlap;
+	int i;
+
+	for (i = 0; i < dev_priv->mm.gtt_clear_count; i++) {
+		c = &dev_priv->mm.gtt_clear[i];
+		c_end = c->first_entry + c->num_entries;
+		if (c_end <= first_entry || c->first_entry >= end)
+			continue;
+
+		if (c->first_entry < first_entry && c_end > end) {
+			/* Bound in the middle of a queued range, split it. */
+			if (dev_priv->mm.gtt_clear_count ==
+			    I915_GTT_CLEAR_RANGES) {
+				i915_gem_gtt_flush_clears(dev);
+				return;
+			}
+			tail = &dev_priv->mm.gtt_clear[
+			    dev_priv->mm.gtt_clear_count++];
+			tail->first_entry = end;
+			tail->num_entries = c_end - end;
+			c->num_entries = first_entry - c->first_entry;
+			overlap = num_entries;
+		} else if (c->first_entry < first_entry) {
+			overlap = c_end - first_entry;
+			c->num_entries -= overlap;
+		} else if (c_end > end) {
+			overlap = end - c->first_entry;
+			c->first_entry = end;
+			c->num_entries -= overlap;
+		} else {
+			overlap = c->num_entries;
+			*c = dev_priv->mm.gtt_clear[
+			    --dev_priv->mm.gtt_clear_count];
+			i--;
+		}
+		dev_priv->mm.gtt_clear_entries -= overlap;
+		dev_priv->mm.gtt_clear_overwritten += overlap;
+	}
+}
+
+/**
+ * Points every queued GTT range at the scratch page.
+ *
+ * Called from the retire worker once the GPU is idle, when the queue is
+ * full, and before the pages of an object with queued PTEs are released.
+ */
+void i915_gem_gtt_flush_clears(struct drm_device *dev)
+{
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	struct i915_gtt_clear *c;
+	int i;
+
+	if (dev_priv->mm.gtt_clear_count == 0)
+		return;
+
+	for (i = 0; i < dev_priv->mm.gtt_clear_count; i++) {
+		c = &dev_priv->mm.gtt_clear[i];
+		__i915_ggtt_clear_range(dev, c->first_entry, c->num_entries);
+	}
+	if (INTEL_INFO(dev)->gen >= 6)
+		readl(dev_priv->mm.gtt->gtt +
+		      dev_priv->mm.gtt_clear[0].first_entry);
+
+	dev_priv->mm.gtt_clear_flushed += dev_priv->mm.gtt_clear_entries;
+	dev_priv->mm.gtt_clear_count = 0;
+	dev_priv->mm.gtt_clear_entries = 0;
 }
 
 void i915_gem_restore_gtt_mappings(struct drm_device *dev)
 {
 	struct drm_i915_private *dev_priv = dev->dev_private;
 	struct drm_i915_gem_object *obj;
+	struct drm_clflush_batch clflush;
 
-	/* First fill our portion of the GTT with scratch pages */
+	/* First fill our portion of the GTT with scratch pages, which also
+	 * takes care of any queued clears.
+	 */
 	i915_ggtt_clear_range(dev, dev_priv->mm.gtt_start / PAGE_SIZE,
 			      (dev_priv->mm.gtt_end - dev_priv->mm.gtt_start) / PAGE_SIZE);
+	dev_priv->mm.gtt_clear_count = 0;
+	dev_priv->mm.gtt_clear_entries = 0;
+
+	drm_clflush_batch_init(&clflush);
+	list_for_each_entry(obj, &dev_priv->mm.bound_list, gtt_list)
+		i915_gem_clflush_object_batch(obj, &clflush);
+	drm_clflush_batch_commit(&clflush);
 
-	list_for_each_entry(obj, &dev_priv->mm.bound_list, gtt_list) {
-		i915_gem_clflush_object(obj);
+	list_for_each_entry(obj, &dev_priv->mm.bound_list, gtt_list)
 		i915_gem_gtt_bind_object(obj, obj->cache_level);
-	}
 
 	i915_gem_chipset_flush(dev);
 }
@@ -491,6 +650,29 @@ int i915_gem_gtt_prepare_object(struct drm_i915_gem_object *obj)
  * within the global GTT as well as accessible by the GPU through the GMADR
  * mapped BAR (dev_priv->mm.gtt->gtt).
  */
+/*
+ * The global GTT is mapped write-combining.  Binds stage their PTEs a
+ * cacheline at a time and write each line with 64-bit stores, so that the
+ * write-combining buffer goes out as full bursts instead of partial ones.
+ */
+#define I915_PTE_BATCH	(64 / sizeof(gtt_pte_t))
+
+static inline void i915_ggtt_write_ptes(gtt_pte_t __iomem *dst,
+					const gtt_pte_t *src, int n)
+{
+	int i = 0;
+
+#ifdef __LP64__
+	if (((uintptr_t)dst & 7) == 0) {
+		for (; i + 1 < n; i += 2)
+			*(volatile uint64_t *)&dst[i] =
+			    *(const uint64_t *)&src[i];
+	}
+#endif
+	for (; i < n; i++)
+		iowrite32(src[i], &dst[i]);
+}
+
 static void gen6_ggtt_bind_object(struct drm_i915_gem_object *obj,
 				  enum i915_cache_level level)
 {
@@ -507,7 +689,9 @@ static void gen6_ggtt_bind_object(struct drm_i915_gem_object *obj,
 	int unused, i = 0;
 	unsigned int len, m = 0;
 #elif __FreeBSD__
-	int i = 0;
+	gtt_pte_t batch[I915_PTE_BATCH] __aligned(8);
+	gtt_pte_t pte_flags;
+	int i, j, n, num_entries;
 #endif
 	dma_addr_t addr;
 
@@ -521,9 +705,15 @@ static void gen6_ggtt_bind_object(struct drm_i915_gem_object *obj,
 		}
 	}
 #elif __FreeBSD__
-	for (i = 0; i < obj->base.size >> PAGE_SHIFT; ++i) {
-		addr = VM_PAGE_TO_PHYS(obj->pages[i]);
-		iowrite32(pte_encode(dev, addr, level), &gtt_entries[i]);
+	pte_flags = pte_encode(dev, 0, level);
+	num_entries = obj->base.size >> PAGE_SHIFT;
+	for (i = 0; i < num_entries; i += n) {
+		n = min_t(int, num_entries - i, I915_PTE_BATCH);
+		for (j = 0; j < n; j++) {
+			addr = VM_PAGE_TO_PHYS(obj->pages[i + j]);
+			batch[j] = GEN6_PTE_ADDR_ENCODE(addr) | pte_flags;
+		}
+		i915_ggtt_write_ptes(&gtt_entries[i], batch, n);
 	}
 #endif
 
@@ -551,6 +741,13 @@ void i915_gem_gtt_bind_object(struct drm_i915_gem_object *obj,
 			      enum i915_cache_level cache_level)
 {
 	struct drm_device *dev = obj->base.dev;
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	sbintime_t start = sbinuptime();
+
+	if (dev_priv->mm.gtt_clear_count != 0)
+		i915_ggtt_clear_cancel(dev, obj->gtt_space->start >> PAGE_SHIFT,
+				       obj->base.size >> PAGE_SHIFT);
+
 	if (INTEL_INFO(dev)->gen < 6) {
 		unsigned int flags = (cache_level == I915_CACHE_NONE) ?
 			AGP_USER_MEMORY : AGP_USER_CACHED_MEMORY;
@@ -567,15 +764,27 @@ void i915_gem_gtt_bind_object(struct drm_i915_gem_object *obj,
 	} else {
 		gen6_ggtt_bind_object(obj, cache_level);
 	}
+	i915_bind_stat_add(&dev_priv->mm.ggtt_bind_stat, start,
+			   obj->base.size >> PAGE_SHIFT);
 
 	obj->has_global_gtt_mapping = 1;
 }
 
 void i915_gem_gtt_unbind_object(struct drm_i915_gem_object *obj)
 {
-	i915_ggtt_clear_range(obj->base.dev,
-			      obj->gtt_space->start >> PAGE_SHIFT,
-			      obj->base.size >> PAGE_SHIFT);
+	struct drm_i915_private *dev_priv = obj->base.dev->dev_private;
+
+	/* With VT-d the PTEs must be gone before the pages are unmapped. */
+	if (unlikely(dev_priv->mm.gtt->do_idle_maps)) {
+		i915_ggtt_clear_range(obj->base.dev,
+				      obj->gtt_space->start >> PAGE_SHIFT,
+				      obj->base.size >> PAGE_SHIFT);
+	} else {
+		i915_ggtt_clear_queue(obj->base.dev,
+				      obj->gtt_space->start >> PAGE_SHIFT,
+				      obj->base.size >> PAGE_SHIFT);
+		obj->gtt_clear_pending = 1;
+	}
 
 	obj->has_global_gtt_mapping = 0;
 }
@@ -33,7 +33,13 @@
 
 #ifdef __FreeBSD__
 #include <sys/sf_buf.h>
+#ifdef __amd64__
+#include <machine/fpu.h>
+#include <machine/md_var.h>
+#include <machine/specialreg.h>
 #endif
+#endif
+#include "i915_swizzle.h"
 
 /** @file i915_gem_tiling.c
  *
@@ -450,6 +456,54 @@ i915_gem_get_tiling(struct drm_device *dev, void *data,
 	return 0;
 }
 
+static int i915_swizzle_impl = I915_SWIZZLE_SCALAR;
+
+/**
+ * Pick the widest moves the CPU and the drm.i915.swizzle_simd tunable allow
+ * for the in-place bit 17 page swizzle.
+ */
+void
+i915_gem_swizzle_init(void)
+{
+	static const char *names[] = { "scalar", "SSE2", "AVX" };
+	int impl = I915_SWIZZLE_SCALAR;
+
+#if defined(__FreeBSD__) && defined(__amd64__)
+	if ((cpu_feature2 & (CPUID2_AVX | CPUID2_OSXSAVE)) ==
+	    (CPUID2_AVX | CPUID2_OSXSAVE))
+		impl = I915_SWIZZLE_AVX;
+	else if ((cpu_feature & CPUID_SSE2) != 0)
+		impl = I915_SWIZZLE_SSE2;
+#endif
+	if (i915_swizzle_simd >= 0 && i915_swizzle_simd < impl)
+		impl = i915_swizzle_simd;
+	i915_swizzle_impl = impl;
+	DRM_DEBUG_DRIVER("bit 17 page swizzle uses %s moves\n", names[impl]);
+}
+
+static inline int
+i915_swizzle_begin(void)
+{
+	int impl = i915_swizzle_impl;
+
+#if defined(__FreeBSD__) && defined(__amd64__)
+	if (impl != I915_SWIZZLE_SCALAR)
+		fpu_kern_enter(curthread, NULL,
+		    FPU_KERN_NORMAL | FPU_KERN_NOCTX);
+#endif
+	return (impl);
+}
+
+static inline void
+i915_swizzle_end(int impl)
+{
+
+#if defined(__FreeBSD__) && defined(__amd64__)
+	if (impl != I915_SWIZZLE_SCALAR)
+		fpu_kern_leave(curthread, NULL);
+#endif
+}
+
 /**
  * Swap every 64 bytes of this page around, to account for it having a new
  * bit 17 of its physical address and therefore being interpreted differently
@@ -458,18 +512,13 @@ i915_gem_get_tiling(struct drm_device *dev, void *data,
 static void
 i915_gem_swizzle_page(struct page *page)
 {
-	char temp[64];
 	char *vaddr;
-	int i;
+	int impl;
 
 	vaddr = kmap(page);
-
-	for (i = 0; i < PAGE_SIZE; i += 128) {
-		memcpy(temp, &vaddr[i], 64);
-		memcpy(&vaddr[i], &vaddr[i + 64], 64);
-		memcpy(&vaddr[i + 64], temp, 64);
-	}
-
+	impl = i915_swizzle_begin();
+	i915_swizzle_page_impl(impl, vaddr);
+	i915_swizzle_end(impl);
 	kunmap(page);
 }
 
@@ -0,0 +1,296 @@
+/*
+ * Userptr objects.
+ *
+ * A userptr object is a GEM object backed by a range of the calling
+ * process' memory instead of a swap-backed VM object.  Large uploads such
+ * as textures and video frames are then bound into the GTT straight from
+ * the user's pages, with no pwrite copy, clflush loop or bit 17 swizzling
+ * on the CPU.
+ *
+ * The pages are faulted in and wired when the object is created, before
+ * the struct mutex is taken, and stay wired until the object is freed.
+ * Faulting them back in later would happen with the struct mutex held,
+ * where a fault on a GTT mapping of another object would deadlock, so the
+ * pages are pinned for the lifetime of the object and the shrinker leaves
+ * them alone.
+ *
+ * Wired pages are charged to the real uid of the creator, summed over all
+ * of its userptr objects, and the total is held to the creating process'
+ * RLIMIT_MEMLOCK.  A cap on each object alone would let a process wire all
+ * of memory one object at a time.
+ */
+
+#include <drm/drmP.h>
+#include <drm/i915_drm.h>
+#include "i915_drv.h"
+#include "i915_trace.h"
+
+#include <sys/lock.h>
+#include <sys/mutex.h>
+#include <sys/resourcevar.h>
+#include <sys/vmmeter.h>
+
+#include <vm/vm.h>
+#include <vm/vm_extern.h>
+#include <vm/vm_map.h>
+#include <vm/vm_page.h>
+
+extern long i915_gem_wired_pages_cnt;
+
+struct i915_gem_userptr_charge {
+	LIST_ENTRY(i915_gem_userptr_charge) link;
+	uid_t uid;
+	u_long npages;
+};
+
+static LIST_HEAD(, i915_gem_userptr_charge) i915_gem_userptr_charges =
+    LIST_HEAD_INITIALIZER(i915_gem_userptr_charges);
+static struct mtx i915_gem_userptr_charge_lock;
+MTX_SYSINIT(i915_gem_userptr_charge, &i915_gem_userptr_charge_lock,
+    "i915up", MTX_DEF);
+
+static struct i915_gem_userptr_charge *
+i915_gem_userptr_charge_lookup(uid_t uid)
+{
+	struct i915_gem_userptr_charge *charge;
+
+	mtx_assert(&i915_gem_userptr_charge_lock, MA_OWNED);
+	LIST_FOREACH(charge, &i915_gem_userptr_charges, link) {
+		if (charge->uid == uid)
+			return charge;
+	}
+	return NULL;
+}
+
+/*
+ * Charge npages wired pages to uid, failing if that takes the uid's total
+ * over limit bytes or the system over vm_page_max_wired, as mlock(2) does.
+ */
+static int
+i915_gem_userptr_charge(uid_t uid, u_long npages, rlim_t limit)
+{
+	struct i915_gem_userptr_charge *charge, *new;
+	int ret;
+
+	new = malloc(sizeof(*new), DRM_MEM_DRIVER, M_WAITOK | M_ZERO);
+	new->uid = uid;
+
+	ret = 0;
+	mtx_lock(&i915_gem_userptr_charge_lock);
+	charge = i915_gem_userptr_charge_lookup(uid);
+	if (charge == NULL) {
+		charge = new;
+		new = NULL;
+		LIST_INSERT_HEAD(&i915_gem_userptr_charges, charge, link);
+	}
+	if (ptoa(charge->npages + npages) > limit ||
+	    npages + vm_cnt.v_wire_count > vm_page_max_wired)
+		ret = -ENOMEM;
+	else
+		charge->npages += npages;
+	if (charge->npages == 0) {
+		LIST_REMOVE(charge, link);
+		new = charge;
+	}
+	mtx_unlock(&i915_gem_userptr_charge_lock);
+
+	free(new, DRM_MEM_DRIVER);
+	return ret;
+}
+
+static void
+i915_gem_userptr_uncharge(uid_t uid, u_long npages)
+{
+	struct i915_gem_userptr_charge *charge;
+
+	mtx_lock(&i915_gem_userptr_charge_lock);
+	charge = i915_gem_userptr_charge_lookup(uid);
+	KASSERT(charge != NULL && charge->npages >= npages,
+	    ("i915_gem_userptr_uncharge: uid %u npages %lu", uid, npages));
+	charge->npages -= npages;
+	if (charge->npages == 0)
+		LIST_REMOVE(charge, link);
+	else
+		charge = NULL;
+	mtx_unlock(&i915_gem_userptr_charge_lock);
+
+	free(charge, DRM_MEM_DRIVER);
+}
+
+static int
+i915_gem_userptr_get_pages(struct drm_i915_gem_object *obj)
+{
+	vm_page_t *ma;
+	int i, page_count, ret;
+
+	if (obj->userptr.vmspace == NULL)
+		return -EFAULT;
+
+	page_count = OFF_TO_IDX(obj->base.size);
+
+	/* Only called from the ioctl, so curproc is the creator. */
+	ret = i915_gem_userptr_charge(obj->userptr.uid, page_count,
+	    lim_cur_proc(curproc, RLIMIT_MEMLOCK));
+	if (ret)
+		return ret;
+
+	ma = kmalloc(page_count * sizeof(vm_page_t), GFP_KERNEL);
+	if (ma == NULL) {
+		ret = -ENOMEM;
+		goto err_uncharge;
+	}
+
+	/* The GTT has no read-only PTEs, always ask for writable pages. */
+	if (vm_fault_quick_hold_pages(&obj->userptr.vmspace->vm_map,
+	    obj->userptr.ptr, obj->base.size, VM_PROT_READ | VM_PROT_WRITE,
+	    ma, page_count) == -1) {
+		ret = -EFAULT;
+		goto err_free;
+	}
+
+	/* Device and GEM mappings are not memory we can bind. */
+	for (i = 0; i < page_count; i++) {
+		if ((ma[i]->flags & PG_FICTITIOUS) != 0) {
+			vm_page_unhold_pages(ma, page_count);
+			ret = -EFAULT;
+			goto err_free;
+		}
+	}
+
+	for (i = 0; i < page_count; i++) {
+		vm_page_lock(ma[i]);
+		vm_page_wire(ma[i]);
+		vm_page_unhold(ma[i]);
+		vm_page_unlock(ma[i]);
+	}
+	atomic_add_long(&i915_gem_wired_pages_cnt, page_count);
+
+	obj->pages = ma;
+	return 0;
+
+err_free:
+	kfree(ma);
+err_uncharge:
+	i915_gem_userptr_uncharge(obj->userptr.uid, page_count);
+	return ret;
+}
+
+static void
+i915_gem_userptr_put_pages(struct drm_i915_gem_object *obj)
+{
+	int page_count = OFF_TO_IDX(obj->base.size);
+	int ret, i;
+
+	ret = i915_gem_object_set_to_cpu_domain(obj, true);
+	if (ret) {
+		/* In the event of a disaster, abandon all caches and
+		 * hope for the best.
+		 */
+		WARN_ON(ret != -EIO);
+		i915_gem_clflush_object(obj);
+		obj->base.read_domains = obj->base.write_domain = I915_GEM_DOMAIN_CPU;
+	}
+
+	for (i = 0; i < page_count; i++) {
+		vm_page_t page = obj->pages[i];
+
+		vm_page_lock(page);
+		if (obj->dirty)
+			vm_page_dirty(page);
+		vm_page_unwire(page, PQ_ACTIVE);
+		vm_page_unlock(page);
+	}
+	atomic_add_long(&i915_gem_wired_pages_cnt, -page_count);
+	i915_gem_userptr_uncharge(obj->userptr.uid, page_count);
+	obj->dirty = 0;
+
+	kfree(obj->pages);
+	obj->pages = NULL;
+}
+
+static void
+i915_gem_userptr_release(struct drm_i915_gem_object *obj)
+{
+
+	if (obj->userptr.vmspace != NULL)
+		vmspace_free(obj->userptr.vmspace);
+	obj->userptr.vmspace = NULL;
+}
+
+static const struct drm_i915_gem_object_ops i915_gem_userptr_ops = {
+	.get_pages = i915_gem_userptr_get_pages,
+	.put_pages = i915_gem_userptr_put_pages,
+	.release = i915_gem_userptr_release,
+};
+
+/**
+ * Creates a new object wrapping a range of the caller's memory and returns
+ * a handle to it.
+ */
+int
+i915_gem_userptr_ioctl(struct drm_device *dev, void *data,
+		       struct drm_file *file)
+{
+	struct drm_i915_private *dev_priv = dev->dev_private;
+	struct drm_i915_gem_userptr *args = data;
+	struct drm_i915_gem_object *obj;
+	u32 handle;
+	int ret;
+
+	if (args->flags != 0)
+		return -EINVAL;
+
+	if (args->user_size == 0 ||
+	    ((args->user_ptr | args->user_size) & (PAGE_SIZE - 1)) != 0)
+		return -EINVAL;
+
+	if (args->user_size > dev_priv->mm.gtt_total ||
+	    args->user_ptr + args->user_size < args->user_ptr)
+		return -EINVAL;
+
+	obj = kzalloc(sizeof(*obj), GFP_KERNEL);
+	if (obj == NULL)
+		return -ENOMEM;
+
+	drm_gem_private_object_init(dev, &obj->base, args->user_size);
+	i915_gem_object_init(obj, &i915_gem_userptr_ops);
+
+	obj->base.write_domain = I915_GEM_DOMAIN_CPU;
+	obj->base.read_domains = I915_GEM_DOMAIN_CPU;
+	if (HAS_LLC(dev))
+		obj->cache_level = I915_CACHE_LLC;
+	else
+		obj->cache_level = I915_CACHE_NONE;
+
+	obj->userptr.vmspace = vmspace_acquire_ref(curproc);
+	obj->userptr.ptr = args->user_ptr;
+	obj->userptr.uid = curthread->td_ucred->cr_ruid;
+
+	/* Fault the range in now, without the struct mutex held, and keep
+	 * the pages pinned so that they are never faulted in under it.
+	 */
+	ret = obj->ops->get_pages(obj);
+	if (ret == 0) {
+		ret = i915_mutex_lock_interruptible(dev);
+		if (ret == 0) {
+			list_add_tail(&obj->gtt_list,
+				      &dev_priv->mm.unbound_list);
+			i915_gem_object_pin_pages(obj);
+			mutex_unlock(&dev->struct_mutex);
+		}
+	}
+
+	if (ret == 0) {
+		ret = drm_gem_handle_create(file, &obj->base, &handle);
+		if (ret == 0)
+			trace_i915_gem_object_create(obj);
+	}
+
+	/* drop reference from allocate - handle holds it now */
+	drm_gem_object_unreference_unlocked(&obj->base);
+	if (ret)
+		return ret;
+
+	args->handle = handle;
+	return 0;
+}
@@ -1252,6 +1252,8 @@ static void i915_gem_record_rings(struct drm_device *dev,
 		error->ring[i].ringbuffer =
 			i915_error_object_create(dev_priv, ring->obj);
 
+		/* Retirement may run concurrently, hold the list steady. */
+		spin_lock(&ring->request_lock);
 		count = 0;
 		list_for_each_entry(request, &ring->request_list, list)
 			count++;
@@ -1262,6 +1264,7 @@ static void i915_gem_record_rings(struct drm_device *dev,
 				GFP_ATOMIC);
 		if (error->ring[i].requests == NULL) {
 			error->ring[i].num_requests = 0;
+			spin_unlock(&ring->request_lock);
 			continue;
 		}
 
@@ -1274,6 +1277,7 @@ static void i915_gem_record_rings(struct drm_device *dev,
 			erq->jiffies = request->emitted_jiffies;
 			erq->tail = request->tail;
 		}
+		spin_unlock(&ring->request_lock);
 	}
 }
 
@@ -1766,9 +1770,19 @@ ring_last_seqno(struct intel_ring_buffer *ring)
 
 static bool i915_hangcheck_ring_idle(struct intel_ring_buffer *ring, bool *err)
 {
-	if (list_empty(&ring->request_list) ||
-	    i915_seqno_passed(ring->get_seqno(ring, false),
-			      ring_last_seqno(ring))) {
+	u32 seqno;
+	bool idle;
+
+	/* Without the request lock, the last request could be retired and
+	 * freed under us.
+	 */
+	seqno = ring->get_seqno(ring, false);
+	spin_lock(&ring->request_lock);
+	idle = list_empty(&ring->request_list) ||
+	    i915_seqno_passed(seqno, ring_last_seqno(ring));
+	spin_unlock(&ring->request_lock);
+
+	if (idle) {
 		/* Issue a wake-up to catch stuck h/w. */
 #ifdef __linux__
 		if (waitqueue_active(&ring->irq_queue)) {
@@ -0,0 +1,114 @@
+/*
+ * Bit 17 page swizzle kernels.
+ *
+ * On machines swizzling with bit 17 of the physical address, a tiled page
+ * whose bit 17 is set has each pair of 64-byte cachelines swapped, i.e.
+ * CPU offset o maps to o ^ 64.  When such a page moves to a frame with a
+ * different bit 17 its halves are swapped in place, with SSE2 and AVX
+ * variants next to the scalar loop.  The AVX variant only needs 256-bit
+ * loads and stores, not AVX2.  pread and pwrite keep copying one cacheline
+ * at a time with copyout/copyin; SIMD line moves measured no faster there,
+ * even before the cost of saving the FPU state.
+ *
+ * The SIMD variants must run with the FPU available to the caller, which
+ * in the kernel means between fpu_kern_enter() and fpu_kern_leave().  The
+ * helpers do not depend on the rest of the driver and are shared with
+ * tools/i915_swizzle_bench.
+ */
+
+#ifndef _I915_SWIZZLE_H_
+#define	_I915_SWIZZLE_H_
+
+#define	I915_SWIZZLE_SCALAR	0
+#define	I915_SWIZZLE_SSE2	1
+#define	I915_SWIZZLE_AVX	2
+
+#ifdef __x86_64__
+#define	I915_SWIZZLE_NIMPL	3
+#else
+#define	I915_SWIZZLE_NIMPL	1
+#endif
+
+#ifdef __x86_64__
+/* Swap the two cachelines of a 128-byte block with all eight loads first. */
+static inline void
+i915_swizzle_block_sse2(char *p)
+{
+
+	__asm __volatile(
+	    "movdqa    (%0), %%xmm0\n\t"
+	    "movdqa  16(%0), %%xmm1\n\t"
+	    "movdqa  32(%0), %%xmm2\n\t"
+	    "movdqa  48(%0), %%xmm3\n\t"
+	    "movdqa  64(%0), %%xmm4\n\t"
+	    "movdqa  80(%0), %%xmm5\n\t"
+	    "movdqa  96(%0), %%xmm6\n\t"
+	    "movdqa 112(%0), %%xmm7\n\t"
+	    "movdqa %%xmm4,    (%0)\n\t"
+	    "movdqa %%xmm5,  16(%0)\n\t"
+	    "movdqa %%xmm6,  32(%0)\n\t"
+	    "movdqa %%xmm7,  48(%0)\n\t"
+	    "movdqa %%xmm0,  64(%0)\n\t"
+	    "movdqa %%xmm1,  80(%0)\n\t"
+	    "movdqa %%xmm2,  96(%0)\n\t"
+	    "movdqa %%xmm3, 112(%0)\n\t"
+	    : : "r" (p)
+	    : "memory", "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5",
+	    "xmm6", "xmm7");
+}
+
+static inline void
+i915_swizzle_block_avx(char *p)
+{
+
+	__asm __volatile(
+	    "vmovdqa   (%0), %%ymm0\n\t"
+	    "vmovdqa 32(%0), %%ymm1\n\t"
+	    "vmovdqa 64(%0), %%ymm2\n\t"
+	    "vmovdqa 96(%0), %%ymm3\n\t"
+	    "vmovdqa %%ymm2,   (%0)\n\t"
+	    "vmovdqa %%ymm3, 32(%0)\n\t"
+	    "vmovdqa %%ymm0, 64(%0)\n\t"
+	    "vmovdqa %%ymm1, 96(%0)\n\t"
+	    : : "r" (p)
+	    : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+}
+
+static inline void
+i915_swizzle_vzeroupper(void)
+{
+
+	__asm __volatile("vzeroupper" : : : "memory");
+}
+#endif /* __x86_64__ */
+
+/* Swap the 64-byte halves of every 128-byte block of a page-aligned page. */
+static inline void
+i915_swizzle_page_impl(int impl, char *vaddr)
+{
+	char temp[64];
+	int i;
+
+	switch (impl) {
+#ifdef __x86_64__
+	case I915_SWIZZLE_SSE2:
+		for (i = 0; i < PAGE_SIZE; i += 128)
+			i915_swizzle_block_sse2(&vaddr[i]);
+		break;
+	case I915_SWIZZLE_AVX:
+		for (i = 0; i < PAGE_SIZE; i += 128)
+			i915_swizzle_block_avx(&vaddr[i]);
+		i915_swizzle_vzeroupper();
+		break;
+#endif
+	default:
+		for (i = 0; i < PAGE_SIZE; i += 128) {
+			memcpy(temp, &vaddr[i], 64);
+			memcpy(&vaddr[i], &vaddr[i + 64], 64);
+			memcpy(&vaddr[i + 64], temp, 64);
+		}
+		break;
+	}
+}
+
+#endif /* _I915_SWIZZLE_H_ */
@@ -67,6 +67,14 @@ struct  intel_ring_buffer {
 	 */
 	u32		last_retired_head;
 
+	/**
+	 * The hardware seqno seen by the last call to
+	 * i915_gem_retire_requests_ring().  Everything that seqno allowed to
+	 * retire has been retired, so a call seeing the same seqno has
+	 * nothing to do.  Zero, which is never emitted, forces a full pass.
+	 */
+	u32		last_retired_seqno;
+
 	u32		irq_refcount;		/* protected by dev_priv->irq_lock */
 	u32		irq_enable_mask;	/* bitmask to enable ring interrupt */
 	u32		trace_irq_seqno;
@@ -117,8 +125,13 @@ struct  intel_ring_buffer {
 	/**
 	 * List of breadcrumbs associated with GPU requests currently
 	 * outstanding.
+	 *
+	 * Changed with both the struct mutex and request_lock held, so either
+	 * is enough to walk it.  The hangcheck timer and error capture, which
+	 * cannot take the struct mutex, use request_lock.
 	 */
 	struct list_head request_list;
+	spinlock_t request_lock;
 
 	/**
 	 * Do we have some not yet emitted requests outstanding?
@@ -256,6 +256,68 @@ int ttm_bo_reserve_nolru(struct ttm_buffer_object *bo,
 	} else {
 		bo->seq_valid = false;
 	}
+	bo->ww_ticket = NULL;
+
+	return 0;
+}
+
+int ttm_bo_reserve_ww_locked(struct ttm_buffer_object *bo,
+			     bool interruptible,
+			     struct ttm_ww_ticket *ticket,
+			     bool slowpath)
+{
+	struct ttm_ww_ticket *holder;
+	bool wake_up = false;
+	int ret;
+
+	while (unlikely(atomic_xchg(&bo->reserved, 1) != 0)) {
+		if (bo->seq_valid && bo->val_seq == ticket->seq)
+			return -EDEADLK;
+
+		if (!slowpath && ticket->wounded)
+			return -EAGAIN;
+
+		holder = bo->ww_ticket;
+		if (bo->seq_valid && bo->val_seq - ticket->seq < (1U << 31)) {
+			/*
+			 * Held by a younger reservation.  If it is still
+			 * reserving, wound it so that it lets go instead of
+			 * ending up waiting for us.
+			 */
+			if (holder != NULL && !holder->wounded) {
+				holder->wounded = true;
+				bo->bdev->ww_wounds++;
+				if (holder->waiting_on != NULL)
+					wakeup(holder->waiting_on);
+			}
+		} else if (!slowpath && bo->seq_valid && holder == NULL) {
+			/*
+			 * An older plain sequence reservation cannot be
+			 * wounded and may be waiting for us.
+			 */
+			return -EAGAIN;
+		}
+
+		ticket->waiting_on = bo;
+		ret = -msleep(bo, &bo->glob->lru_lock,
+		    interruptible ? PCATCH : 0, "ttbwwr", 0);
+		ticket->waiting_on = NULL;
+		if (ret == -EINTR || ret == -ERESTART)
+			return -ERESTARTSYS;
+	}
+
+	/**
+	 * Wake up waiters that may need to recheck for deadlock,
+	 * if we decreased the sequence number.
+	 */
+	if ((bo->val_seq - ticket->seq < (1U << 31)) || !bo->seq_valid)
+		wake_up = true;
+
+	bo->val_seq = ticket->seq;
+	bo->seq_valid = true;
+	bo->ww_ticket = ticket;
+	if (wake_up)
+		wakeup(bo);
 
 	return 0;
 }
@@ -322,6 +384,7 @@ int ttm_bo_reserve_slowpath_nolru(struct ttm_buffer_object *bo,
 	 */
 	bo->val_seq = sequence;
 	bo->seq_valid = true;
+	bo->ww_ticket = NULL;
 	if (wake_up)
 		wakeup(bo);
 
@@ -544,6 +607,18 @@ static void ttm_bo_cleanup_memtype_use(struct ttm_buffer_object *bo)
 	mb();
 }
 
+/*
+ * How long the delayed delete workqueue waits before looking at the list
+ * again.  Drivers calling ttm_bo_device_fence_signaled() kick it as soon
+ * as fences signal, and the timer only catches what they missed.
+ */
+static int ttm_bo_delayed_ticks(struct ttm_bo_device *bdev)
+{
+	if (bdev->fence_notify)
+		return (hz);
+	return (((hz / 100) < 1) ? 1 : hz / 100);
+}
+
 static void ttm_bo_cleanup_refs_or_queue(struct ttm_buffer_object *bo)
 {
 	struct ttm_bo_device *bdev = bo->bdev;
@@ -551,6 +626,7 @@ static void ttm_bo_cleanup_refs_or_queue(struct ttm_buffer_object *bo)
 	struct ttm_bo_driver *driver = bdev->driver;
 	void *sync_obj = NULL;
 	int put_count;
+	int ticks;
 	int ret;
 
 	mtx_lock(&glob->lru_lock);
@@ -582,12 +658,18 @@ static void ttm_bo_cleanup_refs_or_queue(struct ttm_buffer_object *bo)
 	list_add_tail(&bo->ddestroy, &bdev->ddestroy);
 	mtx_unlock(&glob->lru_lock);
 
+	/*
+	 * The fence may have signaled before the buffer made it to the
+	 * list, and the driver will not tell us again.
+	 */
+	ticks = ttm_bo_delayed_ticks(bdev);
 	if (sync_obj) {
 		driver->sync_obj_flush(sync_obj);
+		if (driver->sync_obj_signaled(sync_obj))
+			ticks = 0;
 		driver->sync_obj_unref(&sync_obj);
 	}
-	taskqueue_enqueue_timeout(taskqueue_thread, &bdev->wq,
-	    ((hz / 100) < 1) ? 1 : hz / 100);
+	taskqueue_enqueue_timeout(taskqueue_thread, &bdev->wq, ticks);
 }
 
 /**
@@ -742,16 +824,74 @@ out:
 	return ret;
 }
 
+/**
+ * Take every idle buffer off the delayed list in a single pass under the
+ * lru lock, then release their memory with the lock dropped.  Buffers
+ * that are reserved or still fenced stay queued, without holding up the
+ * ones behind them.  Returns true if buffers remain on the list.
+ */
+
+static bool ttm_bo_delayed_delete_idle(struct ttm_bo_device *bdev)
+{
+	struct ttm_bo_global *glob = bdev->glob;
+	struct ttm_buffer_object *bo, *next;
+	struct list_head batch;
+	bool remaining;
+	int put_count;
+	int ret;
+
+	INIT_LIST_HEAD(&batch);
+	mtx_lock(&glob->lru_lock);
+	list_for_each_entry_safe(bo, next, &bdev->ddestroy, ddestroy) {
+		if (ttm_bo_reserve_nolru(bo, false, true, false, 0) != 0)
+			continue;
+
+		mtx_lock(&bdev->fence_lock);
+		ret = ttm_bo_wait(bo, false, false, true);
+		mtx_unlock(&bdev->fence_lock);
+		if (ret) {
+			atomic_set(&bo->reserved, 0);
+			wakeup(bo);
+			continue;
+		}
+
+		/* Our delayed list reference keeps these from being last. */
+		put_count = ttm_bo_del_from_lru(bo);
+		ttm_bo_list_ref_sub(bo, put_count, true);
+		list_move_tail(&bo->ddestroy, &batch);
+	}
+	remaining = !list_empty(&bdev->ddestroy);
+	mtx_unlock(&glob->lru_lock);
+
+	while (!list_empty(&batch)) {
+		bo = list_first_entry(&batch, struct ttm_buffer_object,
+		    ddestroy);
+		list_del_init(&bo->ddestroy);
+		ttm_bo_cleanup_memtype_use(bo);
+		if (refcount_release(&bo->list_kref))
+			ttm_bo_release_list(bo);
+	}
+
+	return (remaining);
+}
+
 static void ttm_bo_delayed_workqueue(void *arg, int pending __unused)
 {
 	struct ttm_bo_device *bdev = arg;
 
-	if (ttm_bo_delayed_delete(bdev, false)) {
+	if (ttm_bo_delayed_delete_idle(bdev)) {
 		taskqueue_enqueue_timeout(taskqueue_thread, &bdev->wq,
-		    ((hz / 100) < 1) ? 1 : hz / 100);
+		    ttm_bo_delayed_ticks(bdev));
 	}
 }
 
+void ttm_bo_device_fence_signaled(struct ttm_bo_device *bdev)
+{
+	bdev->fence_notify = true;
+	if (!list_empty(&bdev->ddestroy))
+		taskqueue_enqueue_timeout(taskqueue_thread, &bdev->wq, 0);
+}
+
 static void ttm_bo_release(struct ttm_buffer_object *bo)
 {
 	struct ttm_bo_device *bdev = bo->bdev;
@@ -795,7 +935,7 @@ void ttm_bo_unlock_delayed_workqueue(struct ttm_bo_device *bdev, int resched)
 {
 	if (resched) {
 		taskqueue_enqueue_timeout(taskqueue_thread, &bdev->wq,
-		    ((hz / 100) < 1) ? 1 : hz / 100);
+		    ttm_bo_delayed_ticks(bdev));
 	}
 }
 
@@ -1271,6 +1411,7 @@ int ttm_bo_init(struct ttm_bo_device *bdev,
 	bo->priv_flags = 0;
 	bo->mem.placement = (TTM_PL_FLAG_SYSTEM | TTM_PL_FLAG_CACHED);
 	bo->seq_valid = false;
+	bo->ww_ticket = NULL;
 	bo->persistent_swap_storage = persistent_swap_storage;
 	bo->acc_size = acc_size;
 	bo->sg = sg;
@@ -1567,6 +1708,8 @@ int ttm_bo_device_release(struct ttm_bo_device *bdev)
 		TTM_DEBUG("Swap list was clean\n");
 	mtx_unlock(&glob->lru_lock);
 
+	sysctl_ctx_free(&bdev->ww_sysctl_ctx);
+
 	MPASS(drm_mm_clean(&bdev->addr_space_mm));
 	rw_wlock(&bdev->vm_lock);
 	drm_mm_takedown(&bdev->addr_space_mm);
@@ -1575,6 +1718,46 @@ int ttm_bo_device_release(struct ttm_bo_device *bdev)
 	return ret;
 }
 
+static SYSCTL_NODE(_hw_drm, OID_AUTO, ttm_reserve, CTLFLAG_RD, NULL,
+    "TTM ticketed reservations, per device");
+static u_int ttm_bo_device_unit;
+
+static void ttm_bo_device_sysctl_init(struct ttm_bo_device *bdev)
+{
+	struct sysctl_ctx_list *ctx = &bdev->ww_sysctl_ctx;
+	struct sysctl_oid *node;
+	char name[16];
+
+	bdev->ww_reservations = 0;
+	bdev->ww_wounds = 0;
+	bdev->ww_backoffs = 0;
+	bdev->ww_max_backoffs = 0;
+	bdev->ww_max_us = 0;
+
+	sysctl_ctx_init(ctx);
+	snprintf(name, sizeof(name), "%u",
+	    atomic_fetchadd_int(&ttm_bo_device_unit, 1));
+	node = SYSCTL_ADD_NODE(ctx, SYSCTL_STATIC_CHILDREN(_hw_drm_ttm_reserve),
+	    OID_AUTO, name, CTLFLAG_RD, NULL, "TTM device");
+	if (node == NULL)
+		return;
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "reservations",
+	    CTLFLAG_RD, &bdev->ww_reservations,
+	    "Multi-buffer reservations");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "wounds",
+	    CTLFLAG_RD, &bdev->ww_wounds,
+	    "Younger reservations wounded by older ones");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "backoffs",
+	    CTLFLAG_RD, &bdev->ww_backoffs,
+	    "Times a reservation released all its buffers and retried");
+	SYSCTL_ADD_UINT(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "max_backoffs",
+	    CTLFLAG_RD, &bdev->ww_max_backoffs, 0,
+	    "Most backoffs taken by a single reservation");
+	SYSCTL_ADD_ULONG(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "max_us",
+	    CTLFLAG_RD, &bdev->ww_max_us,
+	    "Longest time taken by a single reservation (us)");
+}
+
 int ttm_bo_device_init(struct ttm_bo_device *bdev,
 		       struct ttm_bo_global *glob,
 		       struct ttm_bo_driver *driver,
@@ -1604,10 +1787,12 @@ int ttm_bo_device_init(struct ttm_bo_device *bdev,
 	TIMEOUT_TASK_INIT(taskqueue_thread, &bdev->wq, 0,
 	    ttm_bo_delayed_workqueue, bdev);
 	INIT_LIST_HEAD(&bdev->ddestroy);
+	bdev->fence_notify = false;
 	bdev->dev_mapping = NULL;
 	bdev->glob = glob;
 	bdev->need_dma32 = need_dma32;
 	bdev->val_seq = 0;
+	ttm_bo_device_sysctl_init(bdev);
 	mtx_init(&bdev->fence_lock, "ttmfence", NULL, MTX_DEF);
 	sx_xlock(&glob->device_list_mutex);
 	list_add_tail(&bdev->device_list, &glob->device_list);
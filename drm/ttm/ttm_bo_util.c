@@ -32,6 +32,14 @@
 #include <drm/ttm/ttm_bo_driver.h>
 #include <drm/ttm/ttm_placement.h>
 #include <sys/sf_buf.h>
+#include <sys/smp.h>
+#include <sys/taskqueue.h>
+#ifdef __amd64__
+#include <machine/fpu.h>
+#include <machine/md_var.h>
+#include <machine/specialreg.h>
+#endif
+#include "ttm_copy.h"
 
 void ttm_bo_free_old_node(struct ttm_buffer_object *bo)
 {
@@ -227,17 +235,97 @@ void ttm_mem_reg_iounmap(struct ttm_bo_device *bdev, struct ttm_mem_reg *mem,
 	ttm_mem_io_unlock(man);
 }
 
+/*
+ * ttm_bo_move_memcpy() copies with the widest kernel from ttm_copy.h that
+ * the CPU and hw.drm.ttm_copy.simd allow.  Moves of at least
+ * hw.drm.ttm_copy.split_pages pages between non-overlapping placements are
+ * split into one chunk per worker thread plus one for the caller.  There
+ * are no workers unless the hw.drm.ttm_copy.threads tunable asks for them,
+ * since the split has not been shown to beat copying on the caller.
+ */
+#define	TTM_COPY_MAX_THREADS	8
+
+static SYSCTL_NODE(_hw_drm, OID_AUTO, ttm_copy, CTLFLAG_RD, NULL,
+    "TTM memcpy moves");
+static int ttm_copy_simd = -1;
+SYSCTL_INT(_hw_drm_ttm_copy, OID_AUTO, simd, CTLFLAG_RDTUN, &ttm_copy_simd, 0,
+    "Widest copy kernel to use (-1 best available, 0 scalar, 1 SSE2, "
+    "2 SSE4.1)");
+static int ttm_copy_threads = 0;
+SYSCTL_INT(_hw_drm_ttm_copy, OID_AUTO, threads, CTLFLAG_RDTUN,
+    &ttm_copy_threads, 0,
+    "Worker threads for large moves (default 0, copy on the caller only)");
+static u_long ttm_copy_split_pages = 2048;
+SYSCTL_ULONG(_hw_drm_ttm_copy, OID_AUTO, split_pages, CTLFLAG_RWTUN,
+    &ttm_copy_split_pages, 0,
+    "Split moves of at least this many pages across the workers");
+
+static MALLOC_DEFINE(M_TTM_COPY, "ttm_copy", "TTM Copy Chunks");
+
+static int ttm_copy_impl = TTM_COPY_SCALAR;
+static int ttm_copy_nthreads;
+static struct taskqueue *ttm_copy_tq;
+
+static void
+ttm_copy_init(void *arg __unused)
+{
+	static const char *names[] = { "scalar", "SSE2", "SSE4.1" };
+	int impl = TTM_COPY_SCALAR;
+
+#ifdef __amd64__
+	if ((cpu_feature2 & CPUID2_SSE41) != 0)
+		impl = TTM_COPY_SSE41;
+	else if ((cpu_feature & CPUID_SSE2) != 0)
+		impl = TTM_COPY_SSE2;
+#endif
+	if (ttm_copy_simd >= 0 && ttm_copy_simd < impl)
+		impl = ttm_copy_simd;
+	ttm_copy_impl = impl;
+
+	ttm_copy_nthreads = imin(imin(ttm_copy_threads, mp_ncpus - 1),
+	    TTM_COPY_MAX_THREADS);
+	if (ttm_copy_nthreads > 0) {
+		ttm_copy_tq = taskqueue_create("ttm_copy", M_WAITOK,
+		    taskqueue_thread_enqueue, &ttm_copy_tq);
+		taskqueue_start_threads(&ttm_copy_tq, ttm_copy_nthreads,
+		    PWAIT, "ttm copy");
+	}
+	DRM_DEBUG("[TTM] memcpy moves use %s copies, %d worker threads\n",
+	    names[impl], ttm_copy_nthreads);
+}
+SYSINIT(ttm_copy, SI_SUB_DRIVERS, SI_ORDER_FIRST, ttm_copy_init, NULL);
+
+static void
+ttm_copy_fini(void *arg __unused)
+{
+
+	if (ttm_copy_tq != NULL)
+		taskqueue_free(ttm_copy_tq);
+}
+SYSUNINIT(ttm_copy, SI_SUB_DRIVERS, SI_ORDER_FIRST, ttm_copy_fini, NULL);
+
+static void ttm_copy_page(void *dst, const void *src)
+{
+	int impl = ttm_copy_impl;
+
+#ifdef __amd64__
+	if (impl != TTM_COPY_SCALAR) {
+		fpu_kern_enter(curthread, NULL,
+		    FPU_KERN_NORMAL | FPU_KERN_NOCTX);
+		ttm_copy_page_impl(impl, dst, src);
+		fpu_kern_leave(curthread, NULL);
+		return;
+	}
+#endif
+	ttm_copy_page_impl(impl, dst, src);
+}
+
 static int ttm_copy_io_page(void *dst, void *src, unsigned long page)
 {
-	uint32_t *dstP =
-	    (uint32_t *) ((unsigned long)dst + (page << PAGE_SHIFT));
-	uint32_t *srcP =
-	    (uint32_t *) ((unsigned long)src + (page << PAGE_SHIFT));
-
-	int i;
-	for (i = 0; i < PAGE_SIZE / sizeof(uint32_t); ++i)
-		/* iowrite32(ioread32(srcP++), dstP++); */
-		*dstP++ = *srcP++;
+	void *dstP = (void *)((unsigned long)dst + (page << PAGE_SHIFT));
+	void *srcP = (void *)((unsigned long)src + (page << PAGE_SHIFT));
+
+	ttm_copy_page(dstP, srcP);
 	return 0;
 }
 
@@ -258,7 +346,7 @@ static int ttm_copy_io_ttm_page(struct ttm_tt *ttm, void *src,
 	if (!dst)
 		return -ENOMEM;
 
-	memcpy(dst, src, PAGE_SIZE);
+	ttm_copy_page(dst, src);
 
 	pmap_unmapdev((vm_offset_t)dst, PAGE_SIZE);
 
@@ -280,13 +368,112 @@ static int ttm_copy_ttm_io_page(struct ttm_tt *ttm, void *dst,
 	if (!src)
 		return -ENOMEM;
 
-	memcpy(dst, src, PAGE_SIZE);
+	ttm_copy_page(dst, src);
 
 	pmap_unmapdev((vm_offset_t)src, PAGE_SIZE);
 
 	return 0;
 }
 
+struct ttm_copy_work {
+	struct ttm_tt *ttm;
+	void *old_iomap;
+	void *new_iomap;
+	vm_memattr_t old_prot;
+	vm_memattr_t new_prot;
+	struct mtx lock;
+	int pending;
+	int ret;
+};
+
+struct ttm_copy_chunk {
+	struct task task;
+	struct ttm_copy_work *work;
+	unsigned long first;
+	unsigned long count;
+};
+
+/* Copy count pages, visiting page i * dir + add for i from first on. */
+static int ttm_copy_pages(struct ttm_copy_work *w, unsigned long first,
+			  unsigned long count, int dir, unsigned long add)
+{
+	unsigned long i, page;
+	int ret;
+
+	for (i = first; i < first + count; ++i) {
+		page = i * dir + add;
+		if (w->old_iomap == NULL)
+			ret = ttm_copy_ttm_io_page(w->ttm, w->new_iomap, page,
+						   w->old_prot);
+		else if (w->new_iomap == NULL)
+			ret = ttm_copy_io_ttm_page(w->ttm, w->old_iomap, page,
+						   w->new_prot);
+		else
+			ret = ttm_copy_io_page(w->new_iomap, w->old_iomap,
+					       page);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static void ttm_copy_chunk_task(void *arg, int pending __unused)
+{
+	struct ttm_copy_chunk *c = arg;
+	struct ttm_copy_work *w = c->work;
+	int ret;
+
+	ret = ttm_copy_pages(w, c->first, c->count, 1, 0);
+
+	mtx_lock(&w->lock);
+	if (ret != 0 && w->ret == 0)
+		w->ret = ret;
+	if (--w->pending == 0)
+		wakeup(w);
+	mtx_unlock(&w->lock);
+}
+
+/* Copy the first chunk on the caller while the workers take the rest. */
+static int ttm_copy_pages_split(struct ttm_copy_work *w,
+				unsigned long num_pages)
+{
+	struct ttm_copy_chunk *chunks;
+	unsigned long per, first;
+	int i, ret;
+
+	per = howmany(num_pages, ttm_copy_nthreads + 1);
+	chunks = malloc(ttm_copy_nthreads * sizeof(*chunks), M_TTM_COPY,
+	    M_WAITOK);
+	mtx_init(&w->lock, "ttmcopy", NULL, MTX_DEF);
+	w->pending = 0;
+	w->ret = 0;
+
+	for (i = 0, first = per; i < ttm_copy_nthreads && first < num_pages;
+	     i++, first += per) {
+		chunks[i].work = w;
+		chunks[i].first = first;
+		chunks[i].count = MIN(per, num_pages - first);
+		TASK_INIT(&chunks[i].task, 0, ttm_copy_chunk_task, &chunks[i]);
+		mtx_lock(&w->lock);
+		w->pending++;
+		mtx_unlock(&w->lock);
+		taskqueue_enqueue(ttm_copy_tq, &chunks[i].task);
+	}
+
+	ret = ttm_copy_pages(w, 0, MIN(per, num_pages), 1, 0);
+
+	mtx_lock(&w->lock);
+	while (w->pending != 0)
+		mtx_sleep(w, &w->lock, 0, "ttmcpw", 0);
+	if (ret == 0)
+		ret = w->ret;
+	mtx_unlock(&w->lock);
+
+	mtx_destroy(&w->lock);
+	free(chunks, M_TTM_COPY);
+	return ret;
+}
+
 int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
 		       bool evict, bool no_wait_gpu,
 		       struct ttm_mem_reg *new_mem)
@@ -296,13 +483,13 @@ int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
 	struct ttm_tt *ttm = bo->ttm;
 	struct ttm_mem_reg *old_mem = &bo->mem;
 	struct ttm_mem_reg old_copy = *old_mem;
+	struct ttm_copy_work work;
 	void *old_iomap;
 	void *new_iomap;
 	int ret;
-	unsigned long i;
-	unsigned long page;
 	unsigned long add = 0;
 	int dir;
+	bool overlap;
 
 	ret = ttm_mem_reg_ioremap(bdev, old_mem, &old_iomap);
 	if (ret)
@@ -335,23 +522,26 @@ int ttm_bo_move_memcpy(struct ttm_buffer_object *bo,
 		add = new_mem->num_pages - 1;
 	}
 
-	for (i = 0; i < new_mem->num_pages; ++i) {
-		page = i * dir + add;
-		if (old_iomap == NULL) {
-			vm_memattr_t prot = ttm_io_prot(old_mem->placement);
-			ret = ttm_copy_ttm_io_page(ttm, new_iomap, page,
-						   prot);
-		} else if (new_iomap == NULL) {
-			vm_memattr_t prot = ttm_io_prot(new_mem->placement);
-			ret = ttm_copy_io_ttm_page(ttm, old_iomap, page,
-						   prot);
-		} else
-			ret = ttm_copy_io_page(new_iomap, old_iomap, page);
-		if (ret) {
-			/* failing here, means keep old copy as-is */
-			old_copy.mm_node = NULL;
-			goto out1;
-		}
+	work.ttm = ttm;
+	work.old_iomap = old_iomap;
+	work.new_iomap = new_iomap;
+	work.old_prot = ttm_io_prot(old_mem->placement);
+	work.new_prot = ttm_io_prot(new_mem->placement);
+
+	/* Only disjoint ranges can be copied in any order. */
+	overlap = old_mem->mem_type == new_mem->mem_type &&
+	    new_mem->start < old_mem->start + old_mem->num_pages &&
+	    old_mem->start < new_mem->start + new_mem->num_pages;
+	if (ttm_copy_tq != NULL && !overlap &&
+	    new_mem->num_pages >= ttm_copy_split_pages &&
+	    ttm_copy_split_pages != 0)
+		ret = ttm_copy_pages_split(&work, new_mem->num_pages);
+	else
+		ret = ttm_copy_pages(&work, 0, new_mem->num_pages, dir, add);
+	if (ret) {
+		/* failing here, means keep old copy as-is */
+		old_copy.mm_node = NULL;
+		goto out1;
 	}
 	mb();
 out2:
@@ -416,6 +606,7 @@ ttm_buffer_object_transfer(struct ttm_buffer_object *bo,
 	INIT_LIST_HEAD(&fbo->swap);
 	INIT_LIST_HEAD(&fbo->io_reserve_lru);
 	fbo->vm_node = NULL;
+	fbo->ww_ticket = NULL;
 	atomic_set(&fbo->cpu_writers, 0);
 
 	mtx_lock(&bdev->fence_lock);
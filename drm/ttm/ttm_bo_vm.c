@@ -95,9 +95,97 @@ static struct ttm_buffer_object *ttm_bo_vm_lookup_rb(struct ttm_bo_device *bdev,
 	return best_bo;
 }
 
+/*
+ * Return the page backing pidx of a bo whose placement cannot change
+ * under us, with its caching attribute set for the current placement.
+ */
+static vm_page_t
+ttm_bo_vm_page(struct ttm_buffer_object *bo, vm_pindex_t pidx)
+{
+	vm_page_t m;
+
+	if (bo->mem.bus.is_iomem) {
+		m = PHYS_TO_VM_PAGE(bo->mem.bus.base + bo->mem.bus.offset +
+		    IDX_TO_OFF(pidx));
+		KASSERT((m->flags & PG_FICTITIOUS) != 0,
+		    ("physical address %#jx not fictitious",
+		    (uintmax_t)(bo->mem.bus.base + bo->mem.bus.offset
+		    + IDX_TO_OFF(pidx))));
+		pmap_page_set_memattr(m, ttm_io_prot(bo->mem.placement));
+	} else {
+		m = bo->ttm->pages[pidx];
+		if (unlikely(!m))
+			return (NULL);
+		pmap_page_set_memattr(m,
+		    (bo->mem.placement & TTM_PL_FLAG_CACHED) ?
+		    VM_MEMATTR_WRITE_BACK : ttm_io_prot(bo->mem.placement));
+	}
+	return (m);
+}
+
+/*
+ * Map up to TTM_BO_VM_NUM_PREFAULT - 1 pages following a faulting page
+ * along with it, as Linux does, so that reading through the mapping takes
+ * a fault per window rather than per page.  The pager must return a
+ * contiguous run of busied pages, so the run stops at the first page that
+ * is busied elsewhere.
+ */
+static void
+ttm_bo_vm_prefault(struct ttm_buffer_object *bo, vm_object_t vm_obj,
+    vm_pindex_t pidx, vm_pindex_t *last)
+{
+	vm_pindex_t i, end;
+	vm_page_t m;
+
+	VM_OBJECT_ASSERT_WLOCKED(vm_obj);
+	*last = pidx;
+	end = MIN(pidx + TTM_BO_VM_NUM_PREFAULT, bo->num_pages);
+	for (i = pidx + 1; i < end; i++) {
+		m = vm_page_lookup(vm_obj, i);
+		if (m == NULL) {
+			m = ttm_bo_vm_page(bo, i);
+			if (m == NULL || m->object != NULL ||
+			    vm_page_busied(m))
+				break;
+			if (vm_page_insert(m, vm_obj, i))
+				break;
+			m->valid = VM_PAGE_BITS_ALL;
+		} else if (vm_page_busied(m))
+			break;
+		vm_page_xbusy(m);
+		*last = i;
+	}
+}
+
+/*
+ * Whether a fault can be served without reserving the bo: nobody holds
+ * the reservation, no pipelined move is in flight and the backing store
+ * is already in place, either populated pages or an aperture range
+ * reserved by an earlier fault.
+ *
+ * This is checked with the vm object locked.  A move unmaps the bo
+ * through ttm_bo_release_mmap() while holding the reservation, before it
+ * changes the placement.  A move that has not got that far yet therefore
+ * needs the vm object lock, and removes whatever is mapped here once the
+ * fault is done.  A move that has got further still holds the
+ * reservation, and the fault goes to the slow path.
+ */
+static bool
+ttm_bo_vm_fault_idle(struct ttm_buffer_object *bo)
+{
+
+	if (atomic_read(&bo->reserved) != 0)
+		return (false);
+	if (test_bit(TTM_BO_PRIV_FLAG_MOVING, &bo->priv_flags))
+		return (false);
+	if (bo->mem.bus.is_iomem)
+		return (bo->mem.bus.io_reserved_vm);
+	return (bo->ttm != NULL && bo->ttm->state != tt_unpopulated);
+}
+
 static int
-ttm_bo_vm_fault(vm_object_t vm_obj, vm_ooffset_t offset,
-    int prot, vm_page_t *mres)
+ttm_bo_vm_populate(vm_object_t vm_obj, vm_pindex_t pidx, int fault_type,
+    vm_prot_t max_prot, vm_pindex_t *first, vm_pindex_t *last)
 {
 
 	struct ttm_buffer_object *bo = vm_obj->handle;
@@ -109,12 +197,30 @@ ttm_bo_vm_fault(vm_object_t vm_obj, vm_ooffset_t offset,
 	struct ttm_mem_type_manager *man =
 		&bdev->man[bo->mem.mem_type];
 
+	if (unlikely(pidx >= bo->num_pages))
+		return (VM_PAGER_BAD);
+
 	vm_object_pip_add(vm_obj, 1);
-	if (*mres != NULL) {
-		vm_page_lock(*mres);
-		vm_page_remove(*mres);
-		vm_page_unlock(*mres);
+
+	/* Fast path, for CPU access to an idle bo that is already placed. */
+	if (ttm_bo_vm_fault_idle(bo)) {
+		m = ttm_bo_vm_page(bo, pidx);
+		if (m != NULL && !vm_page_busied(m)) {
+			m1 = vm_page_lookup(vm_obj, pidx);
+			if (m1 == NULL && m->object == NULL &&
+			    vm_page_insert(m, vm_obj, pidx) == 0)
+				m1 = m;
+			if (m1 == m) {
+				m->valid = VM_PAGE_BITS_ALL;
+				vm_page_xbusy(m);
+				*first = pidx;
+				ttm_bo_vm_prefault(bo, vm_obj, pidx, last);
+				vm_object_pip_wakeup(vm_obj);
+				return (VM_PAGER_OK);
+			}
+		}
 	}
+
 retry:
 	VM_OBJECT_WUNLOCK(vm_obj);
 	m = NULL;
@@ -209,24 +315,10 @@ reserve:
 		}
 	}
 
-	if (bo->mem.bus.is_iomem) {
-		m = PHYS_TO_VM_PAGE(bo->mem.bus.base + bo->mem.bus.offset +
-		    offset);
-		KASSERT((m->flags & PG_FICTITIOUS) != 0,
-		    ("physical address %#jx not fictitious",
-		    (uintmax_t)(bo->mem.bus.base + bo->mem.bus.offset
-		    + offset)));
-		pmap_page_set_memattr(m, ttm_io_prot(bo->mem.placement));
-	} else {
-		ttm = bo->ttm;
-		m = ttm->pages[OFF_TO_IDX(offset)];
-		if (unlikely(!m)) {
-			retval = VM_PAGER_ERROR;
-			goto out_io_unlock;
-		}
-		pmap_page_set_memattr(m,
-		    (bo->mem.placement & TTM_PL_FLAG_CACHED) ?
-		    VM_MEMATTR_WRITE_BACK : ttm_io_prot(bo->mem.placement));
+	m = ttm_bo_vm_page(bo, pidx);
+	if (unlikely(!m)) {
+		retval = VM_PAGER_ERROR;
+		goto out_io_unlock;
 	}
 
 	VM_OBJECT_WLOCK(vm_obj);
@@ -239,9 +331,9 @@ reserve:
 		ttm_bo_unreserve(bo);
 		goto retry;
 	}
-	m1 = vm_page_lookup(vm_obj, OFF_TO_IDX(offset));
+	m1 = vm_page_lookup(vm_obj, pidx);
 	if (m1 == NULL) {
-		if (vm_page_insert(m, vm_obj, OFF_TO_IDX(offset))) {
+		if (vm_page_insert(m, vm_obj, pidx)) {
 			VM_OBJECT_WUNLOCK(vm_obj);
 			VM_WAIT;
 			VM_OBJECT_WLOCK(vm_obj);
@@ -251,18 +343,13 @@ reserve:
 		}
 	} else {
 		KASSERT(m == m1,
-		    ("inconsistent insert bo %p m %p m1 %p offset %jx",
-		    bo, m, m1, (uintmax_t)offset));
+		    ("inconsistent insert bo %p m %p m1 %p pidx %jx",
+		    bo, m, m1, (uintmax_t)pidx));
 	}
 	m->valid = VM_PAGE_BITS_ALL;
 	vm_page_xbusy(m);
-	if (*mres != NULL) {
-		KASSERT(*mres != m, ("losing %p %p", *mres, m));
-		vm_page_lock(*mres);
-		vm_page_free(*mres);
-		vm_page_unlock(*mres);
-	}
-	*mres = m;
+	*first = pidx;
+	ttm_bo_vm_prefault(bo, vm_obj, pidx, last);
 
 out_io_unlock1:
 	ttm_mem_io_unlock(man);
@@ -311,7 +398,7 @@ ttm_bo_vm_dtor(void *handle)
 }
 
 static struct cdev_pager_ops ttm_pager_ops = {
-	.cdev_pg_fault = ttm_bo_vm_fault,
+	.cdev_pg_populate = ttm_bo_vm_populate,
 	.cdev_pg_ctor = ttm_bo_vm_ctor,
 	.cdev_pg_dtor = ttm_bo_vm_dtor
 };
@@ -0,0 +1,101 @@
+/*
+ * Page copy kernels for ttm_bo_move_memcpy().
+ *
+ * Moves between VRAM and system memory go through write-combined or
+ * uncached mappings, where a loop of 32-bit accesses is slow: every
+ * uncached load is a round trip to the device, and write-combined stores
+ * only pay off as full lines.  The SSE2 kernel moves 64 bytes per
+ * iteration with non-temporal stores, which bypass the cache and fill
+ * whole write-combining lines.  The SSE4.1 kernel also loads with
+ * movntdqa, which reads write-combined memory a line at a time through
+ * the streaming load buffers and behaves as an ordinary load elsewhere.
+ * Both end with an sfence, so that the data is globally visible before
+ * the move is reported done.
+ *
+ * The SIMD kernels must run with the FPU available to the caller, which
+ * in the kernel means between fpu_kern_enter() and fpu_kern_leave().  The
+ * helpers do not depend on the rest of TTM and are shared with
+ * tools/ttm_copy_bench.
+ */
+
+#ifndef _TTM_COPY_H_
+#define	_TTM_COPY_H_
+
+#define	TTM_COPY_SCALAR		0
+#define	TTM_COPY_SSE2		1
+#define	TTM_COPY_SSE41		2
+
+#ifdef __x86_64__
+#define	TTM_COPY_NIMPL		3
+#else
+#define	TTM_COPY_NIMPL		1
+#endif
+
+#ifdef __x86_64__
+/* Copy len bytes, a multiple of 64, between 16-byte aligned buffers. */
+static inline void
+ttm_copy_sse2(void *dst, const void *src, size_t len)
+{
+	char *d = dst;
+	const char *s = src;
+
+	for (; len != 0; len -= 64, d += 64, s += 64) {
+		__asm __volatile(
+		    "movdqa    (%1), %%xmm0\n\t"
+		    "movdqa  16(%1), %%xmm1\n\t"
+		    "movdqa  32(%1), %%xmm2\n\t"
+		    "movdqa  48(%1), %%xmm3\n\t"
+		    "movntdq %%xmm0,   (%0)\n\t"
+		    "movntdq %%xmm1, 16(%0)\n\t"
+		    "movntdq %%xmm2, 32(%0)\n\t"
+		    "movntdq %%xmm3, 48(%0)\n\t"
+		    : : "r" (d), "r" (s)
+		    : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+	}
+	__asm __volatile("sfence" : : : "memory");
+}
+
+static inline void
+ttm_copy_sse41(void *dst, const void *src, size_t len)
+{
+	char *d = dst;
+	const char *s = src;
+
+	for (; len != 0; len -= 64, d += 64, s += 64) {
+		__asm __volatile(
+		    "movntdqa   (%1), %%xmm0\n\t"
+		    "movntdqa 16(%1), %%xmm1\n\t"
+		    "movntdqa 32(%1), %%xmm2\n\t"
+		    "movntdqa 48(%1), %%xmm3\n\t"
+		    "movntdq %%xmm0,   (%0)\n\t"
+		    "movntdq %%xmm1, 16(%0)\n\t"
+		    "movntdq %%xmm2, 32(%0)\n\t"
+		    "movntdq %%xmm3, 48(%0)\n\t"
+		    : : "r" (d), "r" (s)
+		    : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+	}
+	__asm __volatile("sfence" : : : "memory");
+}
+#endif /* __x86_64__ */
+
+/* Copy one page between page-aligned mappings. */
+static inline void
+ttm_copy_page_impl(int impl, void *dst, const void *src)
+{
+
+	switch (impl) {
+#ifdef __x86_64__
+	case TTM_COPY_SSE2:
+		ttm_copy_sse2(dst, src, PAGE_SIZE);
+		break;
+	case TTM_COPY_SSE41:
+		ttm_copy_sse41(dst, src, PAGE_SIZE);
+		break;
+#endif
+	default:
+		memcpy(dst, src, PAGE_SIZE);
+		break;
+	}
+}
+
+#endif /* _TTM_COPY_H_ */
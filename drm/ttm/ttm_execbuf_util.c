@@ -45,11 +45,27 @@ static void ttm_eu_backoff_reservation_locked(struct list_head *list)
 
 		}
 		entry->reserved = false;
+		bo->ww_ticket = NULL;
+		bo->seq_valid = false;
 		atomic_set(&bo->reserved, 0);
 		wakeup(bo);
 	}
 }
 
+/*
+ * The reservation is complete: the ticket lives on our stack, and
+ * waiters for our buffers now have nothing left to wound.
+ */
+static void ttm_eu_clear_ticket_locked(struct list_head *list)
+{
+	struct ttm_validate_buffer *entry;
+
+	list_for_each_entry(entry, list, head) {
+		entry->bo->ww_ticket = NULL;
+		entry->bo->seq_valid = false;
+	}
+}
+
 static void ttm_eu_del_from_lru_locked(struct list_head *list)
 {
 	struct ttm_validate_buffer *entry;
@@ -101,18 +117,26 @@ void ttm_eu_backoff_reservation(struct list_head *list)
  * If a buffer in the list is marked for CPU access, we back off and
  * wait for that buffer to become free for GPU access.
  *
- * If a buffer is reserved for another validation, the validator with
- * the highest validation sequence backs off and waits for that buffer
- * to become unreserved. This prevents deadlocks when validating multiple
- * buffers in different orders.
+ * Buffers are reserved with wound/wait deadlock avoidance, see
+ * ttm_bo_reserve_ww_locked(). The reservation takes a ticket from the
+ * device validation sequence once. If a buffer is reserved by a younger
+ * validation still reserving, it is wounded and we wait. If we are
+ * wounded or run into a buffer held by an older sequence reservation, we
+ * release everything, sleep for the contended buffer and retry with the
+ * same ticket, so a validation only gets older as it retries and is
+ * never starved by younger ones.
  */
 
 int ttm_eu_reserve_buffers(struct list_head *list)
 {
 	struct ttm_bo_global *glob;
+	struct ttm_bo_device *bdev;
 	struct ttm_validate_buffer *entry;
+	struct ttm_ww_ticket ticket;
+	sbintime_t start;
+	u_long us;
+	u_int backoffs;
 	int ret;
-	uint32_t val_seq;
 
 	if (list_empty(list))
 		return 0;
@@ -125,9 +149,14 @@ int ttm_eu_reserve_buffers(struct list_head *list)
 
 	entry = list_first_entry(list, struct ttm_validate_buffer, head);
 	glob = entry->bo->glob;
+	bdev = entry->bo->bdev;
+	start = sbinuptime();
+	backoffs = 0;
 
 	mtx_lock(&glob->lru_lock);
-	val_seq = entry->bo->bdev->val_seq++;
+	ticket.seq = bdev->val_seq++;
+	ticket.wounded = false;
+	ticket.waiting_on = NULL;
 
 retry_locked:
 	list_for_each_entry(entry, list, head) {
@@ -137,34 +166,26 @@ retry_locked:
 		if (entry->reserved)
 			continue;
 
-		ret = ttm_bo_reserve_nolru(bo, true, true, true, val_seq);
+		/* Take our buffers off the lru lists before we may sleep. */
+		if (atomic_read(&bo->reserved) != 0)
+			ttm_eu_del_from_lru_locked(list);
+
+		ret = ttm_bo_reserve_ww_locked(bo, true, &ticket, false);
 		switch (ret) {
 		case 0:
 			break;
-		case -EBUSY:
-			ttm_eu_del_from_lru_locked(list);
-			ret = ttm_bo_reserve_nolru(bo, true, false,
-						   true, val_seq);
-			if (!ret)
-				break;
-
-			if (unlikely(ret != -EAGAIN))
-				goto err;
-
-			/* fallthrough */
 		case -EAGAIN:
 			ttm_eu_backoff_reservation_locked(list);
+			ttm_eu_list_ref_sub(list);
+			backoffs++;
+			bdev->ww_backoffs++;
 
 			/*
-			 * temporarily increase sequence number every retry,
-			 * to prevent us from seeing our old reservation
-			 * sequence when someone else reserved the buffer,
-			 * but hasn't updated the seq_valid/seqno members yet.
+			 * We hold nothing now, so nobody waits for us.  Sleep
+			 * for the contended buffer and start over with it.
 			 */
-			val_seq = entry->bo->bdev->val_seq++;
-
-			ttm_eu_list_ref_sub(list);
-			ret = ttm_bo_reserve_slowpath_nolru(bo, true, val_seq);
+			ticket.wounded = false;
+			ret = ttm_bo_reserve_ww_locked(bo, true, &ticket, true);
 			if (unlikely(ret != 0)) {
 				mtx_unlock(&glob->lru_lock);
 				return ret;
@@ -187,6 +208,13 @@ retry_locked:
 	}
 
 	ttm_eu_del_from_lru_locked(list);
+	ttm_eu_clear_ticket_locked(list);
+	bdev->ww_reservations++;
+	if (backoffs > bdev->ww_max_backoffs)
+		bdev->ww_max_backoffs = backoffs;
+	us = sbttous(sbinuptime() - start);
+	if (us > bdev->ww_max_us)
+		bdev->ww_max_us = us;
 	mtx_unlock(&glob->lru_lock);
 	ttm_eu_list_ref_sub(list);
 
@@ -40,8 +40,8 @@
  *
  * @tdev: Pointer to the ttm_object_device.
  *
- * @lock: Lock that protects the ref_list list and the
- * ref_hash hash tables.
+ * @lock: Lock that protects the ref_list list and serializes
+ * modifications of the ref_hash hash tables. Lookups are done under RCU.
  *
  * @ref_list: List of ttm_ref_objects to be destroyed at
  * file release.
@@ -55,6 +55,7 @@
 #include <drm/drmP.h>
 #include <drm/drm.h>
 #include <sys/rwlock.h>
+#include <linux/rcupdate.h>
 #include <drm/ttm/ttm_object.h>
 #include <drm/ttm/ttm_module.h>
 
@@ -69,7 +70,8 @@ struct ttm_object_file {
 /**
  * struct ttm_object_device
  *
- * @object_lock: lock that protects the object_hash hash table.
+ * @object_lock: lock that serializes modifications of the object_hash
+ * hash table. Lookups are done under RCU.
  *
  * @object_hash: hash table for fast lookup of object global names.
  *
@@ -94,6 +96,8 @@ struct ttm_object_device {
  *
  * @kref: Ref count.
  *
+ * @rhead: RCU head used to defer freeing until concurrent lookups are done.
+ *
  * @obj: Base object this ref object is referencing.
  *
  * @ref_type: Type of ref object.
@@ -107,6 +111,7 @@ struct ttm_object_device {
  */
 
 struct ttm_ref_object {
+	struct rcu_head rhead;
 	struct drm_hash_item hash;
 	struct list_head head;
 	u_int kref;
@@ -160,7 +165,7 @@ int ttm_base_object_init(struct ttm_object_file *tfile,
 	refcount_init(&base->refcount, 1);
 	rw_init(&tdev->object_lock, "ttmbao");
 	rw_wlock(&tdev->object_lock);
-	ret = drm_ht_just_insert_please(&tdev->object_hash,
+	ret = drm_ht_just_insert_please_rcu(&tdev->object_hash,
 					    &base->hash,
 					    (unsigned long)base, 31, 0, 0);
 	rw_wunlock(&tdev->object_lock);
@@ -176,7 +181,7 @@ int ttm_base_object_init(struct ttm_object_file *tfile,
 	return 0;
 out_err1:
 	rw_wlock(&tdev->object_lock);
-	(void)drm_ht_remove_item(&tdev->object_hash, &base->hash);
+	(void)drm_ht_remove_item_rcu(&tdev->object_hash, &base->hash);
 	rw_wunlock(&tdev->object_lock);
 out_err0:
 	return ret;
@@ -186,12 +191,12 @@ static void ttm_release_base(struct ttm_base_object *base)
 {
 	struct ttm_object_device *tdev = base->tfile->tdev;
 
-	(void)drm_ht_remove_item(&tdev->object_hash, &base->hash);
+	(void)drm_ht_remove_item_rcu(&tdev->object_hash, &base->hash);
 	rw_wunlock(&tdev->object_lock);
 	/*
 	 * Note: We don't use synchronize_rcu() here because it's far
 	 * too slow. It's up to the user to free the object using
-	 * call_rcu() or ttm_base_object_kfree().
+	 * call_rcu() on base->rhead.
 	 */
 
 	if (base->refcount_release) {
@@ -209,8 +214,9 @@ void ttm_base_object_unref(struct ttm_base_object **p_base)
 	*p_base = NULL;
 
 	/*
-	 * Need to take the lock here to avoid racing with
-	 * users trying to look up the object.
+	 * Need to take the lock here to serialize the hash table removal.
+	 * Lookups don't take it; they refuse objects whose refcount
+	 * already dropped to zero.
 	 */
 
 	rw_wlock(&tdev->object_lock);
@@ -227,14 +233,15 @@ struct ttm_base_object *ttm_base_object_lookup(struct ttm_object_file *tfile,
 	struct drm_hash_item *hash;
 	int ret;
 
-	rw_rlock(&tdev->object_lock);
-	ret = drm_ht_find_item(&tdev->object_hash, key, &hash);
+	rcu_read_lock();
+	ret = drm_ht_find_item_rcu(&tdev->object_hash, key, &hash);
 
 	if (ret == 0) {
 		base = drm_hash_entry(hash, struct ttm_base_object, hash);
-		refcount_acquire(&base->refcount);
+		if (!refcount_acquire_if_not_zero(&base->refcount))
+			ret = -EINVAL;
 	}
-	rw_runlock(&tdev->object_lock);
+	rcu_read_unlock();
 
 	if (unlikely(ret != 0))
 		return NULL;
@@ -265,17 +272,19 @@ int ttm_ref_object_add(struct ttm_object_file *tfile,
 		*existed = true;
 
 	while (ret == -EINVAL) {
-		rw_rlock(&tfile->lock);
-		ret = drm_ht_find_item(ht, base->hash.key, &hash);
+		rcu_read_lock();
+		ret = drm_ht_find_item_rcu(ht, base->hash.key, &hash);
 
 		if (ret == 0) {
 			ref = drm_hash_entry(hash, struct ttm_ref_object, hash);
-			refcount_acquire(&ref->kref);
-			rw_runlock(&tfile->lock);
-			break;
+			if (refcount_acquire_if_not_zero(&ref->kref)) {
+				rcu_read_unlock();
+				break;
+			}
+			ret = -EINVAL;
 		}
 
-		rw_runlock(&tfile->lock);
+		rcu_read_unlock();
 		ret = ttm_mem_global_alloc(mem_glob, sizeof(*ref),
 					   false, false);
 		if (unlikely(ret != 0))
@@ -293,7 +302,7 @@ int ttm_ref_object_add(struct ttm_object_file *tfile,
 		refcount_init(&ref->kref, 1);
 
 		rw_wlock(&tfile->lock);
-		ret = drm_ht_insert_item(ht, &ref->hash);
+		ret = drm_ht_insert_item_rcu(ht, &ref->hash);
 
 		if (ret == 0) {
 			list_add_tail(&ref->head, &tfile->ref_list);
@@ -314,6 +323,14 @@ int ttm_ref_object_add(struct ttm_object_file *tfile,
 	return ret;
 }
 
+static void ttm_ref_object_free_rcu(struct rcu_head *rhead)
+{
+	struct ttm_ref_object *ref =
+	    container_of(rhead, struct ttm_ref_object, rhead);
+
+	free(ref, M_TTM_OBJ_REF);
+}
+
 static void ttm_ref_object_release(struct ttm_ref_object *ref)
 {
 	struct ttm_base_object *base = ref->obj;
@@ -322,7 +339,7 @@ static void ttm_ref_object_release(struct ttm_ref_object *ref)
 	struct ttm_mem_global *mem_glob = tfile->tdev->mem_glob;
 
 	ht = &tfile->ref_hash[ref->ref_type];
-	(void)drm_ht_remove_item(ht, &ref->hash);
+	(void)drm_ht_remove_item_rcu(ht, &ref->hash);
 	list_del(&ref->head);
 	rw_wunlock(&tfile->lock);
 
@@ -331,7 +348,7 @@ static void ttm_ref_object_release(struct ttm_ref_object *ref)
 
 	ttm_base_object_unref(&ref->obj);
 	ttm_mem_global_free(mem_glob, sizeof(*ref));
-	free(ref, M_TTM_OBJ_REF);
+	call_rcu(&ref->rhead, ttm_ref_object_free_rcu);
 	rw_wlock(&tfile->lock);
 }
 
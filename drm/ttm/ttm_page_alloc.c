@@ -48,6 +48,10 @@
 #define FREE_ALL_PAGES			(~0U)
 /* times are in msecs */
 #define PAGE_FREE_INTERVAL		1000
+#define TTM_MAG_SIZE			32
+#define TTM_MAG_BATCH			8
+/* no background refill for this long after a lowmem event, in msecs */
+#define TTM_POOL_REFILL_DELAY		1000
 
 /**
  * struct ttm_page_pool - Pool to reuse recently allocated uc/wc pages.
@@ -59,19 +63,43 @@
  * @list: Pool of free uc/wc pages for fast reuse.
  * @gfp_flags: Flags to pass for alloc_page.
  * @npages: Number of pages in pool.
+ * @used: Pool has served an allocation, the refill task only keeps such
+ * pools above the low watermark.
  */
 struct ttm_page_pool {
 	struct mtx		lock;
 	bool			fill_lock;
 	bool			dma32;
+	bool			used;
 	struct pglist		list;
 	int			ttm_page_alloc_flags;
+	enum ttm_caching_state	cstate;
 	unsigned		npages;
 	char			*name;
 	unsigned long		nfrees;
 	unsigned long		nrefills;
+	unsigned long		nasync_refills;
 };
 
+/**
+ * struct ttm_page_mag - Per-CPU page cache in front of a pool.
+ *
+ * ttm_pool_populate() and ttm_pool_unpopulate() allocate and free one page
+ * at a time.  Such small requests are served from the magazine of the
+ * current CPU, which is refilled from and drained to the shared pool
+ * TTM_MAG_BATCH pages at a time, so the pool lock is taken once per batch.
+ * The magazine lock is only contended when a thread migrated or the
+ * shrinker is draining.
+ *
+ * @lock: Protects the magazine.
+ * @count: Number of pages in the magazine, the hottest one on top.
+ */
+struct ttm_page_mag {
+	struct mtx		lock;
+	unsigned		count;
+	vm_page_t		pages[TTM_MAG_SIZE];
+} __aligned(CACHE_LINE_SIZE);
+
 /**
  * Limits for the pool. They are handled without locks because only place where
  * they may change is in sysfs store. They won't have immediate effect anyway
@@ -82,6 +110,7 @@ struct ttm_pool_opts {
 	unsigned	alloc_size;
 	unsigned	max_size;
 	unsigned	small;
+	unsigned	low_watermark;
 };
 
 #define NUM_POOLS 4
@@ -96,6 +125,10 @@ struct ttm_pool_opts {
  * @work: Work that is used to shrink the pool. Work is only run when there is
  * some pages to free.
  * @small_allocation: Limit in number of pages what is small allocation.
+ * @refill_task: Keeps used pools above options.low_watermark, so that the
+ * caching attribute changes of new pages are not paid by allocations.
+ * @lowmem_ticks: Time of the last lowmem event, the refill task holds off
+ * for TTM_POOL_REFILL_DELAY after it.
  *
  * @pools: All pool objects in use.
  **/
@@ -103,6 +136,12 @@ struct ttm_pool_manager {
 	unsigned int kobj_ref;
 	eventhandler_tag lowmem_handler;
 	struct ttm_pool_opts	options;
+	/* NUM_POOLS rows of mp_maxid + 1 magazines */
+	struct ttm_page_mag	*mags;
+	struct taskqueue	*refill_tq;
+	struct timeout_task	refill_task;
+	int			lowmem_ticks;
+	struct sysctl_ctx_list	sysctl_ctx;
 
 	union {
 		struct ttm_page_pool	u_pools[NUM_POOLS];
@@ -208,65 +247,134 @@ ttm_vm_page_alloc(int flags, enum ttm_caching_state cstate)
 	return (p);
 }
 
+/*
+ * Physically contiguous runs, largest first, that ttm_pool_populate()
+ * tries before falling back to single pages: 2M and 64K.  Runs are
+ * aligned to their size so the GPU and CPU can use large mappings.
+ */
+static const unsigned ttm_contig_run_pages[] = {
+	(2 * 1024 * 1024) / PAGE_SIZE,
+	(64 * 1024) / PAGE_SIZE,
+};
+
+static int ttm_set_pages_caching(vm_page_t *pages,
+		enum ttm_caching_state cstate, unsigned cpages);
+
+/*
+ * Allocate a contiguous run of npages with the caching state applied by
+ * the VM as part of the allocation.  Only free memory is used, a failure
+ * here just means the caller goes on with single pages.
+ */
+static int
+ttm_vm_page_alloc_run(vm_page_t *pages, unsigned npages, int flags,
+    enum ttm_caching_state cstate)
+{
+	vm_page_t p;
+	vm_paddr_t high;
+	unsigned i;
+	int req;
+
+	req = VM_ALLOC_NORMAL | VM_ALLOC_WIRED | VM_ALLOC_NOOBJ;
+	if ((flags & TTM_PAGE_FLAG_ZERO_ALLOC) != 0)
+		req |= VM_ALLOC_ZERO;
+	high = (flags & TTM_PAGE_FLAG_DMA32) != 0 ? 0xffffffff :
+	    ~(vm_paddr_t)0;
+	p = vm_page_alloc_contig(NULL, 0, req, npages, 0, high,
+	    ptoa(npages), 0, ttm_caching_state_to_vm(cstate));
+	if (p == NULL)
+		return (-ENOMEM);
+
+	for (i = 0; i < npages; i++) {
+		pages[i] = &p[i];
+		p[i].oflags &= ~VPO_UNMANAGED;
+		p[i].flags |= PG_FICTITIOUS;
+		if ((flags & TTM_PAGE_FLAG_ZERO_ALLOC) != 0 &&
+		    (p[i].flags & PG_ZERO) == 0)
+			pmap_zero_page(&p[i]);
+	}
+	if (ttm_set_pages_caching(pages, cstate, npages) != 0) {
+		for (i = 0; i < npages; i++) {
+			ttm_vm_page_free(pages[i]);
+			pages[i] = NULL;
+		}
+		return (-ENOMEM);
+	}
+	return (0);
+}
+
 static void ttm_pool_kobj_release(struct ttm_pool_manager *m)
 {
 
 	free(m, M_TTM_POOLMGR);
 }
 
-#if 0
-/* XXXKIB sysctl */
-static ssize_t ttm_pool_store(struct ttm_pool_manager *m,
-		struct attribute *attr, const char *buffer, size_t size)
+static struct ttm_pool_manager *_manager;
+
+/*
+ * hw.drm.ttm_pool.* knobs.  Values are in kB, as the Linux sysfs
+ * attributes were, and stored as numbers of pages.
+ */
+static int ttm_pool_sysctl_opt(SYSCTL_HANDLER_ARGS)
 {
-	int chars;
+	unsigned *opt = arg1;
 	unsigned val;
-	chars = sscanf(buffer, "%u", &val);
-	if (chars == 0)
-		return size;
+	int error;
+
+	val = *opt * (PAGE_SIZE >> 10);
+	error = sysctl_handle_int(oidp, &val, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
 
 	/* Convert kb to number of pages */
 	val = val / (PAGE_SIZE >> 10);
-
-	if (attr == &ttm_page_pool_max)
-		m->options.max_size = val;
-	else if (attr == &ttm_page_pool_small)
-		m->options.small = val;
-	else if (attr == &ttm_page_pool_alloc_size) {
+	if (opt == &_manager->options.alloc_size) {
 		if (val > NUM_PAGES_TO_ALLOC*8) {
-			pr_err("Setting allocation size to %lu is not allowed. Recommended size is %lu\n",
+			printf("[TTM] Setting allocation size to %lu is not allowed. Recommended size is %lu\n",
 			       NUM_PAGES_TO_ALLOC*(PAGE_SIZE >> 7),
 			       NUM_PAGES_TO_ALLOC*(PAGE_SIZE >> 10));
-			return size;
+			return (EINVAL);
 		} else if (val > NUM_PAGES_TO_ALLOC) {
-			pr_warn("Setting allocation size to larger than %lu is not recommended\n",
+			printf("[TTM] Setting allocation size to larger than %lu is not recommended\n",
 				NUM_PAGES_TO_ALLOC*(PAGE_SIZE >> 10));
 		}
-		m->options.alloc_size = val;
 	}
-
-	return size;
+	*opt = val;
+	return (0);
 }
 
-static ssize_t ttm_pool_show(struct ttm_pool_manager *m,
-		struct attribute *attr, char *buffer)
+static void ttm_pool_sysctl_init(struct ttm_pool_manager *m)
 {
-	unsigned val = 0;
-
-	if (attr == &ttm_page_pool_max)
-		val = m->options.max_size;
-	else if (attr == &ttm_page_pool_small)
-		val = m->options.small;
-	else if (attr == &ttm_page_pool_alloc_size)
-		val = m->options.alloc_size;
-
-	val = val * (PAGE_SIZE >> 10);
+	struct sysctl_oid *node;
+	static const struct {
+		const char *name;
+		size_t off;
+		const char *descr;
+	} opts[] = {
+		{ "max_size", offsetof(struct ttm_pool_opts, max_size),
+		    "Maximum size of each pool (kB)" },
+		{ "small", offsetof(struct ttm_pool_opts, small),
+		    "Requests below this refill the pool synchronously (kB)" },
+		{ "alloc_size", offsetof(struct ttm_pool_opts, alloc_size),
+		    "Pool refill granularity (kB)" },
+		{ "low_watermark", offsetof(struct ttm_pool_opts,
+		    low_watermark),
+		    "Pools are refilled in the background below this (kB)" },
+	};
+	int i;
 
-	return snprintf(buffer, PAGE_SIZE, "%u\n", val);
+	sysctl_ctx_init(&m->sysctl_ctx);
+	node = SYSCTL_ADD_NODE(&m->sysctl_ctx, SYSCTL_STATIC_CHILDREN(_hw_drm),
+	    OID_AUTO, "ttm_pool", CTLFLAG_RW, NULL, "TTM page pools");
+	if (node == NULL)
+		return;
+	for (i = 0; i < nitems(opts); i++) {
+		SYSCTL_ADD_PROC(&m->sysctl_ctx, SYSCTL_CHILDREN(node),
+		    OID_AUTO, opts[i].name,
+		    CTLTYPE_UINT | CTLFLAG_RW | CTLFLAG_MPSAFE,
+		    (char *)&m->options + opts[i].off, 0,
+		    ttm_pool_sysctl_opt, "IU", opts[i].descr);
+	}
 }
-#endif
-
-static struct ttm_pool_manager *_manager;
 
 static int set_pages_array_wb(vm_page_t *pages, int addrinarray)
 {
@@ -322,6 +430,13 @@ static struct ttm_page_pool *ttm_get_pool(int flags,
 	return &_manager->pools[pool_index];
 }
 
+static struct ttm_page_mag *ttm_pool_mag(struct ttm_page_pool *pool, int cpu)
+{
+
+	return &_manager->mags[(pool - _manager->pools) * (mp_maxid + 1) +
+	    cpu];
+}
+
 /* set memory back to wb and free the pages. */
 static void ttm_pages_put(vm_page_t *pages, unsigned npages)
 {
@@ -431,13 +546,42 @@ out:
 static int ttm_pool_get_num_unused_pages(void)
 {
 	unsigned i;
-	int total = 0;
-	for (i = 0; i < NUM_POOLS; ++i)
+	int cpu, total = 0;
+	for (i = 0; i < NUM_POOLS; ++i) {
 		total += _manager->pools[i].npages;
+		for (cpu = 0; cpu <= mp_maxid; cpu++)
+			total += ttm_pool_mag(&_manager->pools[i], cpu)->count;
+	}
 
 	return total;
 }
 
+static void ttm_page_pool_put(struct ttm_page_pool *pool, vm_page_t *pages,
+			      unsigned npages);
+
+/* Return the pages cached in all magazines to their pools. */
+static void ttm_pool_mags_drain(void)
+{
+	vm_page_t pages[TTM_MAG_SIZE];
+	struct ttm_page_mag *mag;
+	unsigned i, count;
+	int cpu;
+
+	for (i = 0; i < NUM_POOLS; ++i) {
+		for (cpu = 0; cpu <= mp_maxid; cpu++) {
+			mag = ttm_pool_mag(&_manager->pools[i], cpu);
+			mtx_lock(&mag->lock);
+			count = mag->count;
+			memcpy(pages, mag->pages, count * sizeof(vm_page_t));
+			mag->count = 0;
+			mtx_unlock(&mag->lock);
+			if (count)
+				ttm_page_pool_put(&_manager->pools[i], pages,
+				    count);
+		}
+	}
+}
+
 /**
  * Callback for mm to request pool to reduce number of page held.
  */
@@ -449,6 +593,9 @@ static int ttm_pool_mm_shrink(void *arg)
 	struct ttm_page_pool *pool;
 	int shrink_pages = 100; /* XXXKIB */
 
+	/* Magazine pages are only reclaimable once back in their pool. */
+	ttm_pool_mags_drain();
+
 	pool_offset = pool_offset % NUM_POOLS;
 	/* select start pool in round robin fashion */
 	for (i = 0; i < NUM_POOLS; ++i) {
@@ -458,6 +605,12 @@ static int ttm_pool_mm_shrink(void *arg)
 		pool = &_manager->pools[(i + pool_offset)%NUM_POOLS];
 		shrink_pages = ttm_page_pool_free(pool, nr_free);
 	}
+	/*
+	 * Keep the refill task from undoing this.  Pools are topped up again
+	 * by the allocations that drain them once the shortage is over.
+	 */
+	_manager->lowmem_ticks = ticks;
+
 	/* return estimated number of unused pages in pool */
 	return ttm_pool_get_num_unused_pages();
 }
@@ -591,6 +744,23 @@ out:
 	return r;
 }
 
+/*
+ * Put pages allocated for the pool on its list.  After a failure
+ * ttm_alloc_new_pages() leaves the pages it did get on new_pages, with
+ * their caching already set, so count what is actually there.
+ */
+static void ttm_page_pool_splice_locked(struct ttm_page_pool *pool,
+    struct pglist *new_pages)
+{
+	vm_page_t p;
+	unsigned cpages = 0;
+
+	TAILQ_FOREACH(p, new_pages, plinks.q)
+		++cpages;
+	TAILQ_CONCAT(&pool->list, new_pages, plinks.q);
+	pool->npages += cpages;
+}
+
 /**
  * Fill the given pool if there aren't enough pages and the requested number of
  * pages is small.
@@ -598,9 +768,7 @@ out:
 static void ttm_page_pool_fill_locked(struct ttm_page_pool *pool,
     int ttm_flags, enum ttm_caching_state cstate, unsigned count)
 {
-	vm_page_t p;
 	int r;
-	unsigned cpages = 0;
 	/**
 	 * Only allow one pool fill operation at a time.
 	 * If pool doesn't have enough pages for the allocation new pages are
@@ -636,11 +804,7 @@ static void ttm_page_pool_fill_locked(struct ttm_page_pool *pool,
 		} else {
 			printf("[TTM] Failed to fill pool (%p)\n", pool);
 			/* If we have any pages left put them to the pool. */
-			TAILQ_FOREACH(p, &pool->list, plinks.q) {
-				++cpages;
-			}
-			TAILQ_CONCAT(&pool->list, &new_pages, plinks.q);
-			pool->npages += cpages;
+			ttm_page_pool_splice_locked(pool, &new_pages);
 		}
 
 	}
@@ -660,8 +824,10 @@ static unsigned ttm_page_pool_get_pages(struct ttm_page_pool *pool,
 {
 	vm_page_t p;
 	unsigned i;
+	bool refill;
 
 	mtx_lock(&pool->lock);
+	pool->used = true;
 	ttm_page_pool_fill_locked(pool, ttm_flags, cstate, count);
 
 	if (count >= pool->npages) {
@@ -679,27 +845,74 @@ static unsigned ttm_page_pool_get_pages(struct ttm_page_pool *pool,
 	pool->npages -= count;
 	count = 0;
 out:
+	refill = pool->npages < _manager->options.low_watermark;
 	mtx_unlock(&pool->lock);
+	if (refill)
+		taskqueue_enqueue_timeout(_manager->refill_tq,
+		    &_manager->refill_task, 0);
 	return count;
 }
 
-/* Put all pages in pages list to correct pool to wait for reuse */
-static void ttm_put_pages(vm_page_t *pages, unsigned npages, int flags,
-			  enum ttm_caching_state cstate)
+/*
+ * Background refill: top up every pool that has been used to the low
+ * watermark, alloc_size pages at a time.  New pages get their caching
+ * attribute set here rather than in the allocating thread.  The fill is
+ * serialized with the synchronous one in ttm_page_pool_fill_locked() by
+ * pool->fill_lock; a pool being filled there is left alone, the
+ * allocation that follows requeues the task if still needed.  Nothing is
+ * refilled while the system is short of memory.
+ */
+static void ttm_pool_refill_task(void *arg, int pending)
 {
-	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
-	unsigned i;
+	struct ttm_pool_manager *m = arg;
+	struct ttm_page_pool *pool;
+	struct pglist new_pages;
+	unsigned i, low, want;
+	int r;
 
-	if (pool == NULL) {
-		/* No pool for this memory type so free the pages */
-		for (i = 0; i < npages; i++) {
-			if (pages[i]) {
-				ttm_vm_page_free(pages[i]);
-				pages[i] = NULL;
+	if (vm_page_count_severe() ||
+	    ticks - m->lowmem_ticks < hz * TTM_POOL_REFILL_DELAY / 1000)
+		return;
+
+	for (i = 0; i < NUM_POOLS; ++i) {
+		pool = &m->pools[i];
+		low = min(m->options.low_watermark, m->options.max_size);
+		mtx_lock(&pool->lock);
+		if (pool->fill_lock) {
+			mtx_unlock(&pool->lock);
+			continue;
+		}
+		pool->fill_lock = true;
+		for (;;) {
+			want = pool->used && pool->npages < low ?
+			    min(low - pool->npages, m->options.alloc_size) : 0;
+			if (want == 0)
+				break;
+			mtx_unlock(&pool->lock);
+
+			TAILQ_INIT(&new_pages);
+			r = ttm_alloc_new_pages(&new_pages,
+			    pool->ttm_page_alloc_flags, 0, pool->cstate, want);
+			mtx_lock(&pool->lock);
+			/* Partial allocations are kept, as in the sync fill. */
+			ttm_page_pool_splice_locked(pool, &new_pages);
+			if (r != 0) {
+				printf("[TTM] Failed to refill pool %s\n",
+				    pool->name);
+				break;
 			}
+			pool->nasync_refills++;
 		}
-		return;
+		pool->fill_lock = false;
+		mtx_unlock(&pool->lock);
 	}
+}
+
+/* Put pages from the array to the pool, trimming it to max_size. */
+static void ttm_page_pool_put(struct ttm_page_pool *pool, vm_page_t *pages,
+			      unsigned npages)
+{
+	unsigned i;
 
 	mtx_lock(&pool->lock);
 	for (i = 0; i < npages; i++) {
@@ -723,6 +936,56 @@ static void ttm_put_pages(vm_page_t *pages, unsigned npages, int flags,
 		ttm_page_pool_free(pool, npages);
 }
 
+/* Put all pages in pages list to correct pool to wait for reuse */
+static void ttm_put_pages(vm_page_t *pages, unsigned npages, int flags,
+			  enum ttm_caching_state cstate)
+{
+	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
+	struct ttm_page_mag *mag;
+	vm_page_t drain[TTM_MAG_BATCH];
+	unsigned i, ndrain;
+
+	if (pool == NULL) {
+		/* No pool for this memory type so free the pages */
+		for (i = 0; i < npages; i++) {
+			if (pages[i]) {
+				ttm_vm_page_free(pages[i]);
+				pages[i] = NULL;
+			}
+		}
+		return;
+	}
+
+	if (npages > TTM_MAG_BATCH) {
+		ttm_page_pool_put(pool, pages, npages);
+		return;
+	}
+
+	/*
+	 * Small put: stash the pages in this CPU's magazine.  When it is
+	 * full, the coldest TTM_MAG_BATCH pages go back to the pool.
+	 */
+	ndrain = 0;
+	mag = ttm_pool_mag(pool, curcpu);
+	mtx_lock(&mag->lock);
+	for (i = 0; i < npages; i++) {
+		if (pages[i] == NULL)
+			continue;
+		if (mag->count == TTM_MAG_SIZE) {
+			memcpy(drain, mag->pages, sizeof(drain));
+			memmove(mag->pages, mag->pages + TTM_MAG_BATCH,
+			    (TTM_MAG_SIZE - TTM_MAG_BATCH) * sizeof(vm_page_t));
+			mag->count -= TTM_MAG_BATCH;
+			ndrain = TTM_MAG_BATCH;
+		}
+		mag->pages[mag->count++] = pages[i];
+		pages[i] = NULL;
+	}
+	mtx_unlock(&mag->lock);
+	if (ndrain)
+		ttm_page_pool_put(pool, drain, ndrain);
+}
+
 /*
  * On success pages list will hold count number of correctly
  * cached pages.
@@ -731,10 +994,12 @@ static int ttm_get_pages(vm_page_t *pages, unsigned npages, int flags,
 			 enum ttm_caching_state cstate)
 {
 	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
+	struct ttm_page_mag *mag;
 	struct pglist plist;
+	vm_page_t refill[TTM_MAG_BATCH];
 	vm_page_t p = NULL;
 	int gfp_flags;
-	unsigned count;
+	unsigned count, nrefill, i;
 	int r;
 
 	/* No pool for cached pages */
@@ -753,18 +1018,63 @@ static int ttm_get_pages(vm_page_t *pages, unsigned npages, int flags,
 	/* combine zero flag to pool flags */
 	gfp_flags = flags | pool->ttm_page_alloc_flags;
 
-	/* First we take pages from the pool */
-	TAILQ_INIT(&plist);
-	npages = ttm_page_pool_get_pages(pool, &plist, flags, cstate, npages);
 	count = 0;
-	TAILQ_FOREACH(p, &plist, plinks.q) {
-		pages[count++] = p;
-	}
+	if (npages <= TTM_MAG_BATCH) {
+		/* Small request: try this CPU's magazine first. */
+		mag = ttm_pool_mag(pool, curcpu);
+		mtx_lock(&mag->lock);
+		count = min(npages, mag->count);
+		mag->count -= count;
+		memcpy(pages, &mag->pages[mag->count],
+		    count * sizeof(vm_page_t));
+		mtx_unlock(&mag->lock);
+		npages -= count;
+
+		if (npages > 0) {
+			/* Refill: one trip to the pool for a whole batch. */
+			TAILQ_INIT(&plist);
+			(void)ttm_page_pool_get_pages(pool, &plist, flags,
+			    cstate, TTM_MAG_BATCH);
+			nrefill = 0;
+			TAILQ_FOREACH(p, &plist, plinks.q) {
+				if (npages > 0) {
+					pages[count++] = p;
+					npages--;
+				} else
+					refill[nrefill++] = p;
+			}
+			if (nrefill > 0) {
+				mtx_lock(&mag->lock);
+				i = min(nrefill, TTM_MAG_SIZE - mag->count);
+				memcpy(&mag->pages[mag->count], refill,
+				    i * sizeof(vm_page_t));
+				mag->count += i;
+				mtx_unlock(&mag->lock);
+				if (i < nrefill)
+					ttm_page_pool_put(pool, refill + i,
+					    nrefill - i);
+			}
+		}
 
-	/* clear the pages coming from the pool if requested */
-	if (flags & TTM_PAGE_FLAG_ZERO_ALLOC) {
+		/* clear the pages coming from the pool if requested */
+		if (flags & TTM_PAGE_FLAG_ZERO_ALLOC) {
+			for (i = 0; i < count; i++)
+				pmap_zero_page(pages[i]);
+		}
+	} else {
+		/* First we take pages from the pool */
+		TAILQ_INIT(&plist);
+		npages = ttm_page_pool_get_pages(pool, &plist, flags, cstate,
+		    npages);
 		TAILQ_FOREACH(p, &plist, plinks.q) {
-			pmap_zero_page(p);
+			pages[count++] = p;
+		}
+
+		/* clear the pages coming from the pool if requested */
+		if (flags & TTM_PAGE_FLAG_ZERO_ALLOC) {
+			TAILQ_FOREACH(p, &plist, plinks.q) {
+				pmap_zero_page(p);
+			}
 		}
 	}
 
@@ -792,38 +1102,53 @@ static int ttm_get_pages(vm_page_t *pages, unsigned npages, int flags,
 }
 
 static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, int flags,
-				      char *name)
+				      enum ttm_caching_state cstate, char *name)
 {
 	mtx_init(&pool->lock, "ttmpool", NULL, MTX_DEF);
 	pool->fill_lock = false;
 	TAILQ_INIT(&pool->list);
 	pool->npages = pool->nfrees = 0;
 	pool->ttm_page_alloc_flags = flags;
+	pool->cstate = cstate;
 	pool->name = name;
 }
 
 int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 {
+	int i;
 
 	if (_manager != NULL)
 		printf("[TTM] manager != NULL\n");
 	printf("[TTM] Initializing pool allocator\n");
 
 	_manager = malloc(sizeof(*_manager), M_TTM_POOLMGR, M_WAITOK | M_ZERO);
+	_manager->mags = malloc(NUM_POOLS * (mp_maxid + 1) *
+	    sizeof(struct ttm_page_mag), M_TTM_POOLMGR, M_WAITOK | M_ZERO);
+	for (i = 0; i < NUM_POOLS * (mp_maxid + 1); i++)
+		mtx_init(&_manager->mags[i].lock, "ttmmag", NULL, MTX_DEF);
 
-	ttm_page_pool_init_locked(&_manager->wc_pool, 0, "wc");
-	ttm_page_pool_init_locked(&_manager->uc_pool, 0, "uc");
+	ttm_page_pool_init_locked(&_manager->wc_pool, 0, tt_wc, "wc");
+	ttm_page_pool_init_locked(&_manager->uc_pool, 0, tt_uncached, "uc");
 	ttm_page_pool_init_locked(&_manager->wc_pool_dma32,
-	    TTM_PAGE_FLAG_DMA32, "wc dma");
+	    TTM_PAGE_FLAG_DMA32, tt_wc, "wc dma");
 	ttm_page_pool_init_locked(&_manager->uc_pool_dma32,
-	    TTM_PAGE_FLAG_DMA32, "uc dma");
+	    TTM_PAGE_FLAG_DMA32, tt_uncached, "uc dma");
 
 	_manager->options.max_size = max_pages;
 	_manager->options.small = SMALL_ALLOCATION;
 	_manager->options.alloc_size = NUM_PAGES_TO_ALLOC;
+	_manager->options.low_watermark = NUM_PAGES_TO_ALLOC / 4;
+	_manager->lowmem_ticks = ticks - hz * TTM_POOL_REFILL_DELAY / 1000;
+
+	_manager->refill_tq = taskqueue_create("ttm_pool", M_WAITOK,
+	    taskqueue_thread_enqueue, &_manager->refill_tq);
+	taskqueue_start_threads(&_manager->refill_tq, 1, PVM, "ttm pool");
+	TIMEOUT_TASK_INIT(_manager->refill_tq, &_manager->refill_task, 0,
+	    ttm_pool_refill_task, _manager);
 
 	refcount_init(&_manager->kobj_ref, 1);
 	ttm_pool_mm_shrink_init(_manager);
+	ttm_pool_sysctl_init(_manager);
 
 	return 0;
 }
@@ -834,6 +1159,18 @@ void ttm_page_alloc_fini(void)
 
 	printf("[TTM] Finalizing pool allocator\n");
 	ttm_pool_mm_shrink_fini(_manager);
+	sysctl_ctx_free(&_manager->sysctl_ctx);
+
+	if (taskqueue_cancel_timeout(_manager->refill_tq,
+	    &_manager->refill_task, NULL))
+		taskqueue_drain_timeout(_manager->refill_tq,
+		    &_manager->refill_task);
+	taskqueue_free(_manager->refill_tq);
+
+	ttm_pool_mags_drain();
+	for (i = 0; i < NUM_POOLS * (mp_maxid + 1); i++)
+		mtx_destroy(&_manager->mags[i].lock);
+	free(_manager->mags, M_TTM_POOLMGR);
 
 	for (i = 0; i < NUM_POOLS; ++i)
 		ttm_page_pool_free(&_manager->pools[i], FREE_ALL_PAGES);
@@ -846,26 +1183,53 @@ void ttm_page_alloc_fini(void)
 int ttm_pool_populate(struct ttm_tt *ttm)
 {
 	struct ttm_mem_global *mem_glob = ttm->glob->mem_glob;
-	unsigned i;
+	bool run_failed[nitems(ttm_contig_run_pages)] = { false };
+	unsigned i, j, k, n;
 	int ret;
 
 	if (ttm->state != tt_unpopulated)
 		return 0;
 
-	for (i = 0; i < ttm->num_pages; ++i) {
-		ret = ttm_get_pages(&ttm->pages[i], 1,
-				    ttm->page_flags,
-				    ttm->caching_state);
-		if (ret != 0) {
-			ttm_pool_unpopulate(ttm);
-			return -ENOMEM;
+	for (i = 0; i < ttm->num_pages; i += n) {
+		/*
+		 * Try the largest contiguous run that still fits, until
+		 * one of a given size could not be had.  Otherwise take a
+		 * single page from the pool.
+		 */
+		n = 0;
+		for (k = 0; k < nitems(ttm_contig_run_pages); k++) {
+			if (run_failed[k] ||
+			    ttm->num_pages - i < ttm_contig_run_pages[k])
+				continue;
+			if (ttm_vm_page_alloc_run(&ttm->pages[i],
+			    ttm_contig_run_pages[k], ttm->page_flags,
+			    ttm->caching_state) == 0) {
+				n = ttm_contig_run_pages[k];
+				break;
+			}
+			run_failed[k] = true;
+		}
+		if (n == 0) {
+			ret = ttm_get_pages(&ttm->pages[i], 1,
+					    ttm->page_flags,
+					    ttm->caching_state);
+			if (ret != 0) {
+				ttm_pool_unpopulate(ttm);
+				return -ENOMEM;
+			}
+			n = 1;
 		}
 
-		ret = ttm_mem_global_alloc_page(mem_glob, ttm->pages[i],
-						false, false);
-		if (unlikely(ret != 0)) {
-			ttm_pool_unpopulate(ttm);
-			return -ENOMEM;
+		for (j = i; j < i + n; j++) {
+			ret = ttm_mem_global_alloc_page(mem_glob,
+			    ttm->pages[j], false, false);
+			if (unlikely(ret != 0)) {
+				/* Unaccounted pages must not reach unpopulate. */
+				ttm_put_pages(&ttm->pages[j], i + n - j,
+				    ttm->page_flags, ttm->caching_state);
+				ttm_pool_unpopulate(ttm);
+				return -ENOMEM;
+			}
 		}
 	}
 
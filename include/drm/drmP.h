@@ -1014,6 +1014,11 @@ struct drm_driver {
 	int (*gem_init_object) (struct drm_gem_object *obj);
 	void (*gem_free_object) (struct drm_gem_object *obj);
 	int (*gem_open_object) (struct drm_gem_object *, struct drm_file *);
+	/*
+	 * Called before a handle is removed from the file's idr.  On the
+	 * GEM_CLOSE path this runs with file->table_lock held and must not
+	 * sleep.
+	 */
 	void (*gem_close_object) (struct drm_gem_object *, struct drm_file *);
 
 #ifdef FREEBSD_NOTYET
@@ -1538,8 +1543,58 @@ extern int drm_authmagic(struct drm_device *dev, void *data,
 extern int drm_remove_magic(struct drm_master *master, drm_magic_t magic);
 
 /* Cache management (drm_cache.c) */
-void drm_clflush_pages(vm_page_t *pages, unsigned long num_pages);
-void drm_clflush_virt_range(char *addr, unsigned long length);
+
+/*
+ * Flushes are accounted per calling function in hw.drm.clflush.sites.
+ * The site is looked up once per call site and cached in a static.
+ */
+struct drm_clflush_site;
+struct drm_clflush_site *drm_clflush_site_get(const char *name);
+
+#define	DRM_CLFLUSH_SITE() ({						\
+	static struct drm_clflush_site *__drm_clflush_site;		\
+	if (__drm_clflush_site == NULL)					\
+		__drm_clflush_site = drm_clflush_site_get(__func__);	\
+	__drm_clflush_site;						\
+})
+
+void drm_clflush_pages_site(struct drm_clflush_site *site, vm_page_t *pages,
+    unsigned long num_pages);
+void drm_clflush_virt_range_site(struct drm_clflush_site *site, char *addr,
+    unsigned long length);
+
+#define	drm_clflush_pages(pages, num_pages)				\
+	drm_clflush_pages_site(DRM_CLFLUSH_SITE(), (pages), (num_pages))
+#define	drm_clflush_virt_range(addr, length)				\
+	drm_clflush_virt_range_site(DRM_CLFLUSH_SITE(), (addr), (length))
+
+/*
+ * A batch collects the page arrays to flush for one operation, such as an
+ * execbuffer, and flushes them all at commit: line by line while the total
+ * stays below the wbinvd threshold, with a single wbinvd once it does not.
+ * The pages must stay valid until the batch is committed.
+ */
+#define	DRM_CLFLUSH_BATCH	16
+
+struct drm_clflush_batch {
+	struct drm_clflush_site *site;
+	struct {
+		vm_page_t *pages;
+		unsigned long num_pages;
+	} ent[DRM_CLFLUSH_BATCH];
+	int count;
+	unsigned long total;	/* pages added since init */
+	bool all;		/* total reached the threshold, use wbinvd */
+};
+
+void drm_clflush_batch_init_site(struct drm_clflush_batch *batch,
+    struct drm_clflush_site *site);
+void drm_clflush_batch_add(struct drm_clflush_batch *batch, vm_page_t *pages,
+    unsigned long num_pages);
+void drm_clflush_batch_commit(struct drm_clflush_batch *batch);
+
+#define	drm_clflush_batch_init(batch)					\
+	drm_clflush_batch_init_site((batch), DRM_CLFLUSH_SITE())
 
 				/* Locking IOCTL support (drm_lock.h) */
 extern int drm_lock(struct drm_device *dev, void *data,
@@ -47,6 +47,27 @@ struct drm_hash_item {
 struct drm_open_hash {
 	struct hlist_head *table;
 	u8 order;
+	u8 min_order;
+	/* Previous table while its buckets are being migrated to table. */
+	u8 old_order;
+	struct hlist_head *old_table;
+	unsigned int migrate_pos;
+	unsigned long count;
+	unsigned int seq;
+	unsigned int resizes;
+};
+
+#define DRM_HT_STATS_CHAINS 8
+
+struct drm_ht_stats {
+	unsigned long count;
+	unsigned int order;
+	unsigned int resizes;
+	unsigned int migrating;
+	unsigned int used;
+	unsigned int max_chain;
+	/* Number of buckets per chain length, the last slot counts longer. */
+	unsigned int chains[DRM_HT_STATS_CHAINS];
 };
 
 extern int drm_ht_create(struct drm_open_hash *ht, unsigned int order);
@@ -60,8 +81,8 @@ extern void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key);
 extern int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key);
 extern int drm_ht_remove_item(struct drm_open_hash *ht, struct drm_hash_item *item);
 extern void drm_ht_remove(struct drm_open_hash *ht);
+extern void drm_ht_get_stats(struct drm_open_hash *ht, struct drm_ht_stats *stats);
 
-#ifdef __linux__
 /*
  * RCU-safe interface
  *
@@ -69,13 +90,16 @@ extern void drm_ht_remove(struct drm_open_hash *ht);
  * hash table manipulation functions are never run simultaneously.
  * The lookup function drm_ht_find_item_rcu may, however, run simultaneously
  * with any of the manipulation functions as long as it's called from within
- * an RCU read-locked section.
+ * an RCU read-locked section. On FreeBSD the read section and the deferred
+ * frees are backed by the linuxkpi epoch based RCU.
  */
-#define drm_ht_insert_item_rcu drm_ht_insert_item
-#define drm_ht_just_insert_please_rcu drm_ht_just_insert_please
-#define drm_ht_remove_key_rcu drm_ht_remove_key
-#define drm_ht_remove_item_rcu drm_ht_remove_item
-#define drm_ht_find_item_rcu drm_ht_find_item
-#endif
+extern int drm_ht_insert_item_rcu(struct drm_open_hash *ht, struct drm_hash_item *item);
+extern int drm_ht_just_insert_please_rcu(struct drm_open_hash *ht, struct drm_hash_item *item,
+					 unsigned long seed, int bits, int shift,
+					 unsigned long add);
+extern int drm_ht_remove_key_rcu(struct drm_open_hash *ht, unsigned long key);
+extern int drm_ht_remove_item_rcu(struct drm_open_hash *ht, struct drm_hash_item *item);
+extern int drm_ht_find_item_rcu(struct drm_open_hash *ht, unsigned long key,
+				struct drm_hash_item **item);
 
 #endif
@@ -38,10 +38,20 @@
  */
 
 #include <linux/list.h>
+#include <sys/tree.h>
 
 struct drm_mm_node {
 	struct list_head node_list;
 	struct list_head hole_stack;
+	/* Free hole tracking, only valid while hole_follows is set. The
+	 * hole start and size are cached so that the trees stay ordered
+	 * while the scan code temporarily rewires node_list. */
+	RB_ENTRY(drm_mm_node) hole_size_rb;
+	RB_ENTRY(drm_mm_node) hole_addr_rb;
+	unsigned long hole_start;
+	unsigned long hole_size;
+	/* Largest hole_size in this node's hole_addr_rb subtree. */
+	unsigned long hole_max;
 	unsigned hole_follows : 1;
 	unsigned scanned_block : 1;
 	unsigned scanned_prev_free : 1;
@@ -57,6 +67,11 @@ struct drm_mm_node {
 struct drm_mm {
 	/* List of all memory nodes that immediately precede a free hole. */
 	struct list_head hole_stack;
+	/* The same holes, indexed by (size, start) for best-fit searches and
+	 * by start address, augmented with the subtree's largest hole, for
+	 * range restricted searches. */
+	RB_HEAD(drm_mm_hole_size, drm_mm_node) hole_size_rb;
+	RB_HEAD(drm_mm_hole_addr, drm_mm_node) hole_addr_rb;
 	/* head_node.node_list is the list of all memory nodes, ordered
 	 * according to the (increasing) start address of the memory node. */
 	struct drm_mm_node head_node;
@@ -182,6 +197,10 @@ extern int drm_mm_insert_node_in_range_generic(struct drm_mm *mm,
 extern void drm_mm_put_block(struct drm_mm_node *cur);
 extern void drm_mm_remove_node(struct drm_mm_node *node);
 extern void drm_mm_replace_node(struct drm_mm_node *old, struct drm_mm_node *new);
+/*
+ * First fit returns the lowest addressed hole that fits, not the most
+ * recently freed one; best fit returns the smallest.
+ */
 extern struct drm_mm_node *drm_mm_search_free_generic(const struct drm_mm *mm,
 						      unsigned long size,
 						      unsigned alignment,
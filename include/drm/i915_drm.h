@@ -198,6 +198,7 @@ typedef struct _drm_i915_sarea {
 #define DRM_I915_GEM_SET_CACHING	0x2f
 #define DRM_I915_GEM_GET_CACHING	0x30
 #define DRM_I915_REG_READ		0x31
+#define DRM_I915_GEM_USERPTR		0x33
 
 #define DRM_IOCTL_I915_INIT		DRM_IOW( DRM_COMMAND_BASE + DRM_I915_INIT, drm_i915_init_t)
 #define DRM_IOCTL_I915_FLUSH		DRM_IO ( DRM_COMMAND_BASE + DRM_I915_FLUSH)
@@ -247,6 +248,7 @@ typedef struct _drm_i915_sarea {
 #define DRM_IOCTL_I915_GEM_CONTEXT_CREATE	DRM_IOWR (DRM_COMMAND_BASE + DRM_I915_GEM_CONTEXT_CREATE, struct drm_i915_gem_context_create)
 #define DRM_IOCTL_I915_GEM_CONTEXT_DESTROY	DRM_IOW (DRM_COMMAND_BASE + DRM_I915_GEM_CONTEXT_DESTROY, struct drm_i915_gem_context_destroy)
 #define DRM_IOCTL_I915_REG_READ			DRM_IOWR (DRM_COMMAND_BASE + DRM_I915_REG_READ, struct drm_i915_reg_read)
+#define DRM_IOCTL_I915_GEM_USERPTR		DRM_IOWR (DRM_COMMAND_BASE + DRM_I915_GEM_USERPTR, struct drm_i915_gem_userptr)
 
 /* Allow drivers to submit batchbuffers directly to hardware, relying
  * on the security mechanisms provided by hardware.
@@ -308,6 +310,7 @@ typedef struct drm_i915_irq_wait {
 #define I915_PARAM_RSVD_FOR_FUTURE_USE	 22
 #define I915_PARAM_HAS_SECURE_BATCHES	 23
 #define I915_PARAM_HAS_PINNED_BATCHES	 24
+#define I915_PARAM_HAS_EXEC_NO_RELOC	 25
 
 typedef struct drm_i915_getparam {
 	int param;
@@ -628,6 +631,15 @@ struct drm_i915_gem_exec_object2 {
 	__u64 offset;
 
 #define EXEC_OBJECT_NEEDS_FENCE (1<<0)
+/** The object needs a global GTT mapping even with an aliasing PPGTT.
+ * Sandybridge does not redirect MI and PIPE_CONTROL writes of non-secure
+ * batches through the PPGTT, so their targets must carry this flag when
+ * the relocations are not read (I915_EXEC_NO_RELOC). */
+#define EXEC_OBJECT_NEEDS_GTT (1<<1)
+/** The batch writes to this object.  Required with I915_EXEC_NO_RELOC, where
+ * the write domains of the relocations are not read. */
+#define EXEC_OBJECT_WRITE (1<<2)
+#define __EXEC_OBJECT_UNKNOWN_FLAGS -(EXEC_OBJECT_WRITE<<1)
 	__u64 flags;
 	__u64 rsvd1;
 	__u64 rsvd2;
@@ -687,6 +699,17 @@ struct drm_i915_gem_execbuffer2 {
  */
 #define I915_EXEC_IS_PINNED		(1<<10)
 
+/** Userspace promises that the presumed_offset of every relocation matches
+ * the offset it passed in the exec object of the relocation target.  The
+ * kernel then only checks that no object moved and, if none did, skips
+ * reading the relocations altogether.  The offset of each exec object is
+ * updated on return as usual.  Since the relocation domains may go unread,
+ * every object the batch writes must carry EXEC_OBJECT_WRITE, and every
+ * MI or PIPE_CONTROL write target EXEC_OBJECT_NEEDS_GTT.
+ * Only available through execbuffer2.
+ */
+#define I915_EXEC_NO_RELOC		(1<<11)
+
 #define I915_EXEC_CONTEXT_ID_MASK	(0xffffffff)
 #define i915_execbuffer2_set_context_id(eb2, context) \
 	(eb2).rsvd1 = context & I915_EXEC_CONTEXT_ID_MASK
@@ -961,6 +984,22 @@ struct drm_i915_reg_read {
 	__u64 val; /* Return value */
 };
 
+/*
+ * Wrap a range of the caller's memory as a GEM object.  The pages are
+ * pinned for the lifetime of the object and bound into the GTT directly,
+ * so uploads through it need no pwrite copy.  user_ptr and user_size must
+ * be page aligned and the range writable, as the GTT cannot map pages
+ * read-only.  pread, pwrite and CPU mmap are not available on such
+ * objects; the caller already has the memory mapped.
+ */
+struct drm_i915_gem_userptr {
+	__u64 user_ptr;
+	__u64 user_size;
+	__u32 flags;	/* must be zero */
+	/** Returned handle for the object. */
+	__u32 handle;
+};
+
 /* For use by IPS driver */
 extern unsigned long i915_read_mch_val(void);
 extern bool i915_gpu_raise(void);
@@ -142,6 +142,25 @@ enum ttm_bo_type {
 
 struct ttm_tt;
 
+/**
+ * struct ttm_ww_ticket
+ *
+ * @seq: Age of the reservation, taken from bo_device::val_seq. Lower is
+ * older, and the ticket keeps its age when it backs off and retries.
+ * @wounded: Set by an older reservation waiting for one of our buffers.
+ * We must release everything we hold and start over.
+ * @waiting_on: The buffer we are sleeping on, so that a wound wakes us.
+ *
+ * A multi-buffer reservation in progress, see ttm_eu_reserve_buffers().
+ * All members are protected by the bo_device::lru_lock.
+ */
+
+struct ttm_ww_ticket {
+	uint32_t seq;
+	bool wounded;
+	struct ttm_buffer_object *waiting_on;
+};
+
 /**
  * struct ttm_buffer_object
  *
@@ -174,6 +193,9 @@ struct ttm_tt;
  * buffer. This member is protected by the bo_device::lru_lock.
  * @seq_valid: The value of @val_seq is valid. This value is protected by
  * the bo_device::lru_lock.
+ * @ww_ticket: The ticketed reservation holding the @reserved lock while it
+ * is still reserving its other buffers, NULL otherwise. Protected by the
+ * bo_device::lru_lock.
  * @reserved: Deadlock-free lock used for synchronization state transitions.
  * @sync_obj: Pointer to a synchronization object.
  * @priv_flags: Flags describing buffer object internal state.
@@ -250,6 +272,7 @@ struct ttm_buffer_object {
 	struct list_head io_reserve_lru;
 	uint32_t val_seq;
 	bool seq_valid;
+	struct ttm_ww_ticket *ww_ticket;
 
 	/**
 	 * Members protected by the bdev::lru_lock
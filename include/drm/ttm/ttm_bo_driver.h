@@ -548,9 +548,14 @@ struct ttm_bo_global {
  * lru_lock: Spinlock that protects the buffer+device lru lists and
  * ddestroy lists.
  * @val_seq: Current validation sequence.
+ * @ww_reservations, @ww_wounds, @ww_backoffs, @ww_max_backoffs,
+ * @ww_max_us: Ticketed reservation counters, see ttm_eu_reserve_buffers().
+ * Protected by the lru_lock and exported under hw.drm.ttm_reserve.
  * @dev_mapping: A pointer to the struct address_space representing the
  * device address space.
  * @wq: Work queue structure for the delayed delete workqueue.
+ * @fence_notify: The driver calls ttm_bo_device_fence_signaled(), the
+ * delayed delete workqueue need not poll.
  *
  */
 
@@ -590,6 +595,13 @@ struct ttm_bo_device {
 	struct list_head ddestroy;
 	uint32_t val_seq;
 
+	u_long ww_reservations;
+	u_long ww_wounds;
+	u_long ww_backoffs;
+	u_int ww_max_backoffs;
+	u_long ww_max_us;
+	struct sysctl_ctx_list ww_sysctl_ctx;
+
 	/*
 	 * Protected by load / firstopen / lastclose /unload sync.
 	 */
@@ -605,6 +617,7 @@ struct ttm_bo_device {
 #else
 	struct timeout_task wq;
 #endif
+	bool fence_notify;
 
 	bool need_dma32;
 };
@@ -793,6 +806,24 @@ extern int ttm_bo_device_init(struct ttm_bo_device *bdev,
 			      struct ttm_bo_driver *driver,
 			      uint64_t file_page_offset, bool need_dma32);
 
+/**
+ * ttm_bo_device_fence_signaled
+ *
+ * @bdev: A pointer to a struct ttm_bo_device.
+ *
+ * To be called by the driver when sync objects of @bdev have signaled,
+ * typically from its fence interrupt or retire path. Buffers on the
+ * delayed destroy list whose sync objects are done are then freed right
+ * away rather than by a polling timer. Once a driver has called this,
+ * the timer only runs as a backstop. Must not be called after
+ * ttm_bo_device_release().
+ *
+ * No TTM driver is part of this tree, so nothing here calls it; it is
+ * meant for TTM drivers built out of tree. Without a caller, delayed
+ * destroy keeps polling every 10ms.
+ */
+extern void ttm_bo_device_fence_signaled(struct ttm_bo_device *bdev);
+
 /**
  * ttm_bo_unmap_virtual
  *
@@ -923,6 +954,34 @@ extern int ttm_bo_reserve_nolru(struct ttm_buffer_object *bo,
 				 bool no_wait, bool use_sequence,
 				 uint32_t sequence);
 
+/**
+ * ttm_bo_reserve_ww_locked:
+ *
+ * @bo: A pointer to a struct ttm_buffer_object.
+ * @interruptible: Sleep interruptible if waiting.
+ * @ticket: The multi-buffer reservation this is part of.
+ * @slowpath: The ticket holds no other buffer, wait for @bo whatever
+ * happens.
+ *
+ * Reserves @bo for @ticket with wound/wait deadlock avoidance. A ticket
+ * finding @bo held by a younger ticket wounds it and waits. A ticket
+ * finding @bo held by an older one just waits. Called and returns with
+ * the lru_lock held, which is dropped while sleeping. Will not remove
+ * @bo from the lru lists.
+ *
+ * Returns:
+ * -EAGAIN: @ticket was wounded, or @bo is held by an older reservation
+ * made with ttm_bo_reserve_nolru(), which knows nothing about wounds.
+ * Release all buffers and retry with the same ticket.
+ * -EDEADLK: @bo is already reserved by @ticket.
+ * -ERESTARTSYS: A wait for the buffer to become unreserved was
+ * interrupted by a signal.
+ */
+extern int ttm_bo_reserve_ww_locked(struct ttm_buffer_object *bo,
+				    bool interruptible,
+				    struct ttm_ww_ticket *ticket,
+				    bool slowpath);
+
 /**
  * ttm_bo_unreserve
  *
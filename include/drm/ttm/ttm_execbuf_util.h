@@ -74,9 +74,10 @@ extern void ttm_eu_backoff_reservation(struct list_head *list);
  * If the function returns 0, all buffers are marked as "unfenced",
  * taken off the lru lists and are not synced for write CPU usage.
  *
- * If the function detects a deadlock due to multiple threads trying to
- * reserve the same buffers in reverse order, all threads except one will
- * back off and retry. This function may sleep while waiting for
+ * Deadlocks due to multiple threads trying to reserve the same buffers
+ * in reverse order are avoided with wound/wait: the oldest validation
+ * always proceeds, younger ones back off when it needs their buffers and
+ * retry keeping their age. This function may sleep while waiting for
  * CPU write reservations to be cleared, and for other threads to
  * unreserve their buffers.
  *
@@ -40,6 +40,7 @@
 
 #include <drm/drm_hashtab.h>
 #include <drm/ttm/ttm_memory.h>
+#include <linux/rcupdate.h>
 
 /**
  * enum ttm_ref_type
@@ -106,7 +107,10 @@ struct ttm_object_device;
  * destroy the object (or make sure destruction eventually happens),
  * and when it is called, the object has
  * already been taken out of the per-device hash. The parameter
- * "base" should be set to NULL by the function.
+ * "base" should be set to NULL by the function. Since lookups are
+ * lockless, the memory must not be reused before an RCU grace period:
+ * free it from a call_rcu() callback on @rhead, with the malloc(9) type
+ * it was allocated with.
  *
  * @ref_obj_release: A function to be called when a reference object
  * with another ttm_ref_type than TTM_REF_USAGE is deleted.
@@ -119,9 +123,7 @@ struct ttm_object_device;
  */
 
 struct ttm_base_object {
-#ifdef FREEBSD_NOTYET
 	struct rcu_head rhead;
-#endif
 	struct drm_hash_item hash;
 	enum ttm_object_type object_type;
 	bool shareable;
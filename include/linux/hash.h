@@ -27,24 +27,23 @@
 #ifndef _LINUX_HASH_H_
 #define _LINUX_HASH_H_
 
-#include <sys/hash.h>
+/*
+ * Multiplicative hashing, as in Linux: the top bits of the product are
+ * the best mixed ones. The previous version shifted the 32-bit
+ * hash32_buf() result right by 64 - bits on 64-bit platforms, which sent
+ * every key to bucket 0.
+ */
+#define GOLDEN_RATIO_32 0x61C88647UL
+#define GOLDEN_RATIO_64 0x61C8864680B583EBULL
 
 static inline u64 hash_64(u64 val, unsigned int bits)
 {
-	u64 ret;
-
-	ret = (uint64_t)hash32_buf(&val, sizeof(val), bits);
-
-	return ret >> (64 - bits);
+	return (val * GOLDEN_RATIO_64) >> (64 - bits);
 }
 
 static inline u32 hash_32(u32 val, unsigned int bits)
 {
-	u32 ret;
-
-	ret = hash32_buf(&val, sizeof(val), bits);
-
-	return ret >> (32 - bits);
+	return ((u32)(val * GOLDEN_RATIO_32)) >> (32 - bits);
 }
 
 #if BITS_PER_LONG == 64	/* amd64 */
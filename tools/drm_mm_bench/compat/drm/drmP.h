@@ -0,0 +1,55 @@
+/*
+ * Minimal userspace stand-in for drmP.h, just enough to build drm_mm.c
+ * outside the kernel.
+ */
+
+#ifndef _DRM_MM_BENCH_DRMP_H_
+#define	_DRM_MM_BENCH_DRMP_H_
+
+#include <sys/types.h>
+#include <sys/cdefs.h>
+#include <sys/tree.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/list.h>
+
+#ifndef __DECONST
+#define	__DECONST(type, var)	((type)(uintptr_t)(const void *)(var))
+#endif
+
+#define	likely(x)	__builtin_expect(!!(x), 1)
+#define	unlikely(x)	__builtin_expect(!!(x), 0)
+
+#define	BUG_ON(x) do {							\
+	if (x) {							\
+		fprintf(stderr, "BUG_ON(%s) at %s:%d\n", #x,		\
+		    __FILE__, __LINE__);				\
+		abort();						\
+	}								\
+} while (0)
+
+typedef int spinlock_t;
+#define	spin_lock_init(l)	do { } while (0)
+#define	spin_lock(l)		do { } while (0)
+#define	spin_unlock(l)		do { } while (0)
+
+#define	GFP_KERNEL	0
+#define	GFP_ATOMIC	1
+#define	kzalloc(size, flags)	calloc(1, (size))
+#define	kfree(ptr)		free(ptr)
+
+#define	KERN_DEBUG	""
+#define	printk		printf
+#define	DRM_ERROR(fmt, ...)	fprintf(stderr, "[drm:%s] *ERROR* " fmt, \
+				    __func__, ##__VA_ARGS__)
+
+extern unsigned long drm_mm_search_steps;
+#define	DRM_MM_SEARCH_STEP()	(drm_mm_search_steps++)
+
+#endif /* _DRM_MM_BENCH_DRMP_H_ */
@@ -0,0 +1,115 @@
+/*
+ * The subset of the Linux list API used by drm_mm.c.
+ */
+
+#ifndef _DRM_MM_BENCH_LIST_H_
+#define	_DRM_MM_BENCH_LIST_H_
+
+#include <stddef.h>
+
+struct list_head {
+	struct list_head *next;
+	struct list_head *prev;
+};
+
+#ifndef container_of
+#define	container_of(ptr, type, member)					\
+	((type *)((char *)(ptr) - offsetof(type, member)))
+#endif
+
+#define	list_entry(ptr, type, member)	container_of(ptr, type, member)
+
+#define	INIT_LIST_HEAD(head) do {					\
+	(head)->next = (head);						\
+	(head)->prev = (head);						\
+} while (0)
+
+static inline void
+__list_add(struct list_head *new, struct list_head *prev,
+    struct list_head *next)
+{
+
+	next->prev = new;
+	new->next = next;
+	new->prev = prev;
+	prev->next = new;
+}
+
+static inline void
+list_add(struct list_head *new, struct list_head *head)
+{
+
+	__list_add(new, head, head->next);
+}
+
+static inline void
+list_add_tail(struct list_head *new, struct list_head *head)
+{
+
+	__list_add(new, head->prev, head);
+}
+
+static inline void
+__list_del(struct list_head *entry)
+{
+
+	entry->next->prev = entry->prev;
+	entry->prev->next = entry->next;
+}
+
+static inline void
+list_del(struct list_head *entry)
+{
+
+	__list_del(entry);
+	entry->next = entry->prev = NULL;
+}
+
+static inline void
+list_move(struct list_head *entry, struct list_head *head)
+{
+
+	__list_del(entry);
+	list_add(entry, head);
+}
+
+static inline void
+list_move_tail(struct list_head *entry, struct list_head *head)
+{
+
+	__list_del(entry);
+	list_add_tail(entry, head);
+}
+
+static inline void
+list_replace(struct list_head *old, struct list_head *new)
+{
+
+	new->next = old->next;
+	new->next->prev = new;
+	new->prev = old->prev;
+	new->prev->next = new;
+}
+
+static inline int
+list_empty(const struct list_head *head)
+{
+
+	return (head->next == head);
+}
+
+#define	list_first_entry(head, type, member)				\
+	list_entry((head)->next, type, member)
+
+#define	list_for_each_entry(pos, head, member)				\
+	for (pos = list_entry((head)->next, __typeof(*pos), member);	\
+	    &pos->member != (head);					\
+	    pos = list_entry(pos->member.next, __typeof(*pos), member))
+
+#define	list_for_each_entry_safe(pos, n, head, member)			\
+	for (pos = list_entry((head)->next, __typeof(*pos), member),	\
+	    n = list_entry(pos->member.next, __typeof(*pos), member);	\
+	    &pos->member != (head);					\
+	    pos = n, n = list_entry(n->member.next, __typeof(*n), member))
+
+#endif /* _DRM_MM_BENCH_LIST_H_ */
@@ -0,0 +1 @@
+/* kzalloc() and kfree() are provided by the compat drmP.h. */
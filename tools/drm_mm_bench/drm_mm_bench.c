@@ -0,0 +1,401 @@
+/*-
+ * Userspace benchmark for the drm_mm range allocator.
+ *
+ * drm_mm.c is built unmodified against a small compat shim and driven
+ * either by a synthetic aperture workload or by a recorded trace.  When an
+ * insert does not fit, space is made the way i915_gem_evict_something()
+ * does it: the allocated nodes are fed to the drm_mm scan API in LRU order
+ * and the ones it selects are evicted.
+ *
+ * Trace format, one operation per line, '#' starts a comment:
+ *
+ *	i <id> <size> <alignment> [<start> <end>]	insert, first fit
+ *	I <id> <size> <alignment> [<start> <end>]	insert, best fit
+ *	r <id>						remove
+ *	s <size> <alignment> [<start> <end>]		evict for a hole
+ *
+ * Sizes and offsets are in bytes; ids are small integers below -m.
+ */
+
+#include <drm/drmP.h>
+#include <drm/drm_mm.h>
+
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#define	PAGE_SIZE		4096UL
+#define	STEP_BUCKETS		24
+
+unsigned long drm_mm_search_steps;
+
+struct bench_obj {
+	struct drm_mm_node *node;
+	struct list_head lru;
+	struct list_head evict;
+	unsigned long size;
+};
+
+struct bench_stats {
+	uint64_t ops;
+	uint64_t inserts;
+	uint64_t insert_fail;
+	uint64_t removes;
+	uint64_t scans;
+	uint64_t evicted;
+	uint64_t evicted_bytes;
+	uint64_t steps[STEP_BUCKETS];
+	uint64_t max_steps;
+};
+
+static struct drm_mm mm;
+static struct list_head lru;
+static struct bench_obj *objs;
+static unsigned long nobjs = 1024;
+static unsigned long mm_start = 0;
+static unsigned long mm_size = 256UL << 20;
+static struct bench_stats stats;
+
+static void
+usage(void)
+{
+
+	fprintf(stderr,
+	    "usage: drm_mm_bench [-b] [-a aperture_mb] [-m max_objects] "
+	    "[-n ops] [-s seed]\n"
+	    "                    [-w churn|mappable|trace] [-t trace_file]\n");
+	exit(1);
+}
+
+static void
+account_steps(void)
+{
+	unsigned long steps = drm_mm_search_steps;
+	int bucket = 0;
+
+	while (bucket < STEP_BUCKETS - 1 && (1UL << bucket) <= steps)
+		bucket++;
+	stats.steps[bucket]++;
+	if (steps > stats.max_steps)
+		stats.max_steps = steps;
+	drm_mm_search_steps = 0;
+}
+
+static void
+obj_remove(struct bench_obj *obj)
+{
+
+	drm_mm_put_block(obj->node);
+	obj->node = NULL;
+	list_del(&obj->lru);
+	stats.removes++;
+}
+
+/*
+ * Make room for size bytes by scanning the LRU, like
+ * i915_gem_evict_something().  Returns 0 when a hole was made.
+ */
+static int
+evict_something(unsigned long size, unsigned alignment, unsigned long start,
+    unsigned long end, bool ranged)
+{
+	struct list_head unwind;
+	struct bench_obj *obj, *next;
+	int found = 0;
+
+	stats.scans++;
+	INIT_LIST_HEAD(&unwind);
+	if (ranged)
+		drm_mm_init_scan_with_range(&mm, size, alignment, 0, start,
+		    end);
+	else
+		drm_mm_init_scan(&mm, size, alignment, 0);
+
+	list_for_each_entry(obj, &lru, lru) {
+		list_add(&obj->evict, &unwind);
+		if (drm_mm_scan_add_block(obj->node)) {
+			found = 1;
+			break;
+		}
+	}
+
+	/* Nodes must leave the scan list in the reverse order they joined. */
+	list_for_each_entry_safe(obj, next, &unwind, evict) {
+		if (!drm_mm_scan_remove_block(obj->node) || !found)
+			list_del(&obj->evict);
+	}
+
+	list_for_each_entry_safe(obj, next, &unwind, evict) {
+		list_del(&obj->evict);
+		stats.evicted++;
+		stats.evicted_bytes += obj->size;
+		obj_remove(obj);
+	}
+
+	return (found ? 0 : -ENOSPC);
+}
+
+static int
+obj_insert(unsigned long id, unsigned long size, unsigned alignment,
+    unsigned long start, unsigned long end, bool ranged, bool best)
+{
+	struct bench_obj *obj;
+	struct drm_mm_node *hole;
+	int ret;
+
+	if (id >= nobjs) {
+		fprintf(stderr, "object id %lu out of range\n", id);
+		return (-EINVAL);
+	}
+	obj = &objs[id];
+	if (obj->node != NULL)
+		obj_remove(obj);
+
+	for (;;) {
+		drm_mm_search_steps = 0;
+		if (ranged)
+			hole = drm_mm_search_free_in_range_generic(&mm, size,
+			    alignment, 0, start, end, best);
+		else
+			hole = drm_mm_search_free_generic(&mm, size,
+			    alignment, 0, best);
+		account_steps();
+		if (hole != NULL)
+			break;
+		ret = evict_something(size, alignment, start, end, ranged);
+		if (ret != 0) {
+			stats.insert_fail++;
+			return (ret);
+		}
+	}
+
+	/* Same search and get_block sequence as ttm_bo_man_get_node(). */
+	if (ranged)
+		obj->node = drm_mm_get_block_range_generic(hole, size,
+		    alignment, 0, start, end, 0);
+	else
+		obj->node = drm_mm_get_block_generic(hole, size, alignment,
+		    0, 0);
+	if (obj->node == NULL) {
+		stats.insert_fail++;
+		return (-ENOMEM);
+	}
+	obj->size = size;
+	list_add_tail(&obj->lru, &lru);
+	stats.inserts++;
+	return (0);
+}
+
+static void
+obj_touch(struct bench_obj *obj)
+{
+
+	list_move_tail(&obj->lru, &lru);
+}
+
+static unsigned long
+rand_size(void)
+{
+	unsigned long r = random() % 100;
+
+	/* Mostly small buffers, a tail of large textures and scanouts. */
+	if (r < 60)
+		return ((1 + random() % 16) * PAGE_SIZE);
+	if (r < 90)
+		return ((16 + random() % 240) * PAGE_SIZE);
+	if (r < 98)
+		return ((256 + random() % 1792) * PAGE_SIZE);
+	return ((2048 + random() % 2048) * PAGE_SIZE);
+}
+
+static void
+run_synthetic(uint64_t nops, bool mappable, bool best)
+{
+	unsigned long id, size, mappable_end;
+	unsigned alignment;
+	uint64_t i;
+
+	mappable_end = mm_start + mm_size / 4;
+	for (i = 0; i < nops; i++) {
+		id = random() % nobjs;
+		stats.ops++;
+		if (objs[id].node != NULL) {
+			/* Half of the hits are reuse, the rest free. */
+			if (random() & 1)
+				obj_touch(&objs[id]);
+			else
+				obj_remove(&objs[id]);
+			continue;
+		}
+		size = rand_size();
+		alignment = (random() % 8) == 0 ? 64 * 1024 : 0;
+		if (mappable && (random() % 3) == 0)
+			obj_insert(id, size, alignment, mm_start, mappable_end,
+			    true, best);
+		else
+			obj_insert(id, size, alignment, mm_start,
+			    mm_start + mm_size, false, best);
+	}
+}
+
+static int
+run_trace(const char *path)
+{
+	char line[256];
+	unsigned long id, size, start, end;
+	unsigned alignment;
+	FILE *f;
+	char op;
+	int n, lineno = 0;
+
+	f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		return (-1);
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		op = line[0];
+		stats.ops++;
+		switch (op) {
+		case 'i':
+		case 'I':
+			n = sscanf(line + 1, "%lu %lu %u %lu %lu", &id, &size,
+			    &alignment, &start, &end);
+			if (n != 3 && n != 5)
+				goto bad;
+			obj_insert(id, size, alignment, start, end, n == 5,
+			    op == 'I');
+			break;
+		case 'r':
+			if (sscanf(line + 1, "%lu", &id) != 1 || id >= nobjs)
+				goto bad;
+			if (objs[id].node != NULL)
+				obj_remove(&objs[id]);
+			break;
+		case 's':
+			n = sscanf(line + 1, "%lu %u %lu %lu", &size,
+			    &alignment, &start, &end);
+			if (n != 2 && n != 4)
+				goto bad;
+			evict_something(size, alignment, start, end, n == 4);
+			break;
+		default:
+			goto bad;
+		}
+	}
+	if (f != stdin)
+		fclose(f);
+	return (0);
+
+bad:
+	fprintf(stderr, "%s:%d: malformed trace line\n", path, lineno);
+	if (f != stdin)
+		fclose(f);
+	return (-1);
+}
+
+static void
+report(double elapsed)
+{
+	struct drm_mm_node *entry, *root;
+	unsigned long holes = 0, free_bytes = 0, largest = 0;
+	int i;
+
+	list_for_each_entry(entry, &mm.hole_stack, hole_stack) {
+		holes++;
+		free_bytes += entry->hole_size;
+	}
+	root = RB_ROOT(&mm.hole_addr_rb);
+	if (root != NULL)
+		largest = root->hole_max;
+
+	printf("ops             %" PRIu64 " in %.3f s, %.0f ops/s\n",
+	    stats.ops, elapsed, elapsed > 0 ? stats.ops / elapsed : 0.0);
+	printf("inserts         %" PRIu64 " (%" PRIu64 " failed)\n",
+	    stats.inserts, stats.insert_fail);
+	printf("removes         %" PRIu64 "\n", stats.removes);
+	printf("eviction scans  %" PRIu64 ", %" PRIu64 " nodes, %" PRIu64
+	    " KiB\n", stats.scans, stats.evicted, stats.evicted_bytes >> 10);
+	printf("holes           %lu, largest %lu KiB, free %lu KiB of %lu KiB\n",
+	    holes, largest >> 10, free_bytes >> 10, mm_size >> 10);
+	printf("search steps    max %" PRIu64 "\n", stats.max_steps);
+	for (i = 0; i < STEP_BUCKETS; i++) {
+		if (stats.steps[i] == 0)
+			continue;
+		if (i <= 1)
+			printf("  %10d  %" PRIu64 "\n", i, stats.steps[i]);
+		else
+			printf("  %4lu-%-5lu  %" PRIu64 "\n", 1UL << (i - 1),
+			    (1UL << i) - 1, stats.steps[i]);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	struct timespec t0, t1;
+	const char *workload = "churn", *trace = NULL;
+	uint64_t nops = 1000000;
+	unsigned long seed = 1;
+	bool best = false;
+	int ch, ret = 0;
+
+	while ((ch = getopt(argc, argv, "a:bm:n:s:t:w:")) != -1) {
+		switch (ch) {
+		case 'a':
+			mm_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			best = true;
+			break;
+		case 'm':
+			nobjs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nops = strtoull(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			trace = optarg;
+			workload = "trace";
+			break;
+		case 'w':
+			workload = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (mm_size == 0 || nobjs == 0 ||
+	    (strcmp(workload, "trace") == 0 && trace == NULL))
+		usage();
+
+	objs = calloc(nobjs, sizeof(*objs));
+	if (objs == NULL) {
+		perror("calloc");
+		return (1);
+	}
+	srandom(seed);
+	INIT_LIST_HEAD(&lru);
+	drm_mm_init(&mm, mm_start, mm_size);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (strcmp(workload, "churn") == 0)
+		run_synthetic(nops, false, best);
+	else if (strcmp(workload, "mappable") == 0)
+		run_synthetic(nops, true, best);
+	else if (strcmp(workload, "trace") == 0)
+		ret = run_trace(trace);
+	else
+		usage();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	report((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	return (ret != 0);
+}
@@ -0,0 +1,429 @@
+/*-
+ * Replayable simulator of the GTT eviction policies.
+ *
+ * A sequence of submissions, each a set of objects that must all be bound
+ * at once, is replayed against an aperture of fixed size under every
+ * policy of i915_evict.h, using the same helpers as the driver.  Bound
+ * idle objects sit on a list in order of last use, like the inactive
+ * list, and are evicted from its head until the submission fits.  The
+ * aperture is modelled as a byte count, fragmentation and the drm_mm
+ * hole search are not.  Reported is the number of bytes evicted per
+ * submission, which is what has to be faulted or rebound back in.
+ *
+ * Submissions come from a trace file (-t), one per line, each a list of
+ * "handle:size" pairs with the size in bytes, or from a generator (-g):
+ *
+ *	mixed	a rotating quarter of a hot set plus fresh one-shot objects,
+ *		like render passes reusing resources alongside uploads
+ *	loop	a cyclic working set slightly larger than the aperture
+ *	zipf	objects drawn from a pool with a skewed popularity
+ *
+ * -o writes the generated submissions out as a trace for later replay.
+ */
+
+#include <sys/param.h>
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef roundup2
+#define	roundup2(x, y)	(((x) + ((y) - 1)) & (~((y) - 1)))
+#endif
+
+#include "i915_evict.h"
+
+static const char *policy_names[] = { "list", "gclock" };
+
+struct sim_ent {
+	uint32_t handle;
+	uint64_t size;
+};
+
+struct sim_trace {
+	struct sim_ent *ents;
+	size_t nents, ents_alloc;
+	size_t *start;		/* first ent of each submission */
+	size_t nsubs, subs_alloc;
+	uint32_t max_handle;
+};
+
+struct sim_obj {
+	uint64_t size;
+	uint32_t last_use;
+	uint8_t reuse;
+	bool bound;
+	bool pinned;
+	uint32_t prev, next;	/* inactive list links, 0 is the head */
+};
+
+struct sim_result {
+	uint64_t evicted_bytes;
+	uint64_t evictions;
+	uint64_t too_big;
+};
+
+static void
+trace_begin_sub(struct sim_trace *t)
+{
+
+	if (t->nsubs == t->subs_alloc) {
+		t->subs_alloc = t->subs_alloc ? t->subs_alloc * 2 : 1024;
+		t->start = realloc(t->start, t->subs_alloc * sizeof(*t->start));
+		if (t->start == NULL)
+			err(1, "realloc");
+	}
+	t->start[t->nsubs++] = t->nents;
+}
+
+static void
+trace_add(struct sim_trace *t, uint32_t handle, uint64_t size)
+{
+
+	if (handle == 0)
+		errx(1, "handle 0 is reserved");
+	if (t->nents == t->ents_alloc) {
+		t->ents_alloc = t->ents_alloc ? t->ents_alloc * 2 : 4096;
+		t->ents = realloc(t->ents, t->ents_alloc * sizeof(*t->ents));
+		if (t->ents == NULL)
+			err(1, "realloc");
+	}
+	t->ents[t->nents].handle = handle;
+	t->ents[t->nents].size = size;
+	t->nents++;
+	if (handle > t->max_handle)
+		t->max_handle = handle;
+}
+
+static size_t
+trace_sub_end(const struct sim_trace *t, size_t sub)
+{
+
+	return (sub + 1 < t->nsubs ? t->start[sub + 1] : t->nents);
+}
+
+static void
+trace_read(struct sim_trace *t, const char *path)
+{
+	char *line = NULL, *tok, *p;
+	size_t cap = 0;
+	unsigned long handle;
+	unsigned long long size;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		err(1, "%s", path);
+	while (getline(&line, &cap, f) > 0) {
+		if ((p = strchr(line, '#')) != NULL)
+			*p = '\0';
+		p = line;
+		tok = strtok(p, " \t\n");
+		if (tok == NULL)
+			continue;
+		trace_begin_sub(t);
+		for (; tok != NULL; tok = strtok(NULL, " \t\n")) {
+			if (sscanf(tok, "%lu:%llu", &handle, &size) != 2)
+				errx(1, "%s: bad entry \"%s\"", path, tok);
+			trace_add(t, handle, size);
+		}
+	}
+	free(line);
+	fclose(f);
+}
+
+static void
+trace_write(const struct sim_trace *t, const char *path)
+{
+	size_t sub, i;
+	FILE *f;
+
+	f = fopen(path, "w");
+	if (f == NULL)
+		err(1, "%s", path);
+	for (sub = 0; sub < t->nsubs; sub++) {
+		for (i = t->start[sub]; i < trace_sub_end(t, sub); i++)
+			fprintf(f, "%s%" PRIu32 ":%" PRIu64,
+			    i == t->start[sub] ? "" : " ",
+			    t->ents[i].handle, t->ents[i].size);
+		fprintf(f, "\n");
+	}
+	if (fclose(f) != 0)
+		err(1, "%s", path);
+}
+
+static uint64_t
+obj_size(uint64_t mean)
+{
+
+	/* Pages, between a quarter and twice the mean. */
+	return (roundup2(mean / 4 + random() % (mean * 7 / 4), 4096));
+}
+
+static void
+trace_generate(struct sim_trace *t, const char *workload,
+    unsigned long nsubs, uint64_t aperture)
+{
+	uint64_t mean = 1024 * 1024, *sizes;
+	uint32_t next_handle, hot, i, j, k, pool;
+	unsigned long sub;
+	double *cdf, sum, r;
+
+	if (strcmp(workload, "mixed") == 0) {
+		/*
+		 * The hot set is three quarters of the aperture, a quarter
+		 * of it per submission, and 24 objects are used only once.
+		 */
+		hot = aperture * 3 / 4 / mean;
+		sizes = calloc(hot + 1, sizeof(*sizes));
+		if (sizes == NULL)
+			err(1, "calloc");
+		for (i = 1; i <= hot; i++)
+			sizes[i] = obj_size(mean);
+		next_handle = hot + 1;
+		for (sub = 0; sub < nsubs; sub++) {
+			trace_begin_sub(t);
+			k = (sub % 4) * (hot / 4);
+			for (i = 0; i < hot / 4; i++) {
+				j = 1 + (k + i) % hot;
+				trace_add(t, j, sizes[j]);
+			}
+			for (i = 0; i < 24; i++)
+				trace_add(t, next_handle++, obj_size(mean));
+		}
+		free(sizes);
+	} else if (strcmp(workload, "loop") == 0) {
+		/* 16 objects per submission cycling through 1.1 apertures. */
+		pool = aperture * 11 / 10 / mean;
+		for (sub = 0; sub < nsubs; sub++) {
+			trace_begin_sub(t);
+			for (i = 0; i < 16; i++)
+				trace_add(t, 1 + (sub * 16 + i) % pool, mean);
+		}
+	} else if (strcmp(workload, "zipf") == 0) {
+		/* Four apertures of objects, popularity ~ 1 / rank. */
+		pool = aperture * 4 / mean;
+		sizes = calloc(pool + 1, sizeof(*sizes));
+		cdf = calloc(pool + 1, sizeof(*cdf));
+		if (sizes == NULL || cdf == NULL)
+			err(1, "calloc");
+		sum = 0;
+		for (i = 1; i <= pool; i++) {
+			sizes[i] = obj_size(mean);
+			sum += 1.0 / i;
+			cdf[i] = sum;
+		}
+		for (sub = 0; sub < nsubs; sub++) {
+			trace_begin_sub(t);
+			for (i = 0; i < 24; i++) {
+				r = (double)random() / RAND_MAX * sum;
+				for (j = 1; j < pool && cdf[j] < r; j++)
+					;
+				trace_add(t, j, sizes[j]);
+			}
+		}
+		free(sizes);
+		free(cdf);
+	} else
+		errx(1, "unknown workload %s", workload);
+}
+
+static void
+list_del_obj(struct sim_obj *o, uint32_t h)
+{
+
+	o[o[h].prev].next = o[h].next;
+	o[o[h].next].prev = o[h].prev;
+}
+
+static void
+list_add_tail_obj(struct sim_obj *o, uint32_t h)
+{
+
+	o[h].prev = o[0].prev;
+	o[h].next = 0;
+	o[o[0].prev].next = h;
+	o[0].prev = h;
+}
+
+static void
+evict_obj(struct sim_obj *o, uint32_t h, uint64_t *free_bytes,
+    struct sim_result *res)
+{
+
+	list_del_obj(o, h);
+	o[h].bound = false;
+	*free_bytes += o[h].size;
+	res->evicted_bytes += o[h].size;
+	res->evictions++;
+}
+
+/* Evict from the head of the list until need bytes are free. */
+static void
+evict(struct sim_obj *o, int policy, uint64_t need, uint64_t *free_bytes,
+    struct sim_result *res)
+{
+	uint32_t h, next, last;
+
+	/* Objects given a second chance go to the tail, as in the driver. */
+	if (policy == I915_EVICT_GCLOCK) {
+		last = o[0].prev;
+		for (h = o[0].next; h != 0 && *free_bytes < need; h = next) {
+			next = o[h].next;
+			if (o[h].pinned)
+				;
+			else if (i915_evict_second_chance(&o[h].reuse)) {
+				list_del_obj(o, h);
+				list_add_tail_obj(o, h);
+			} else
+				evict_obj(o, h, free_bytes, res);
+			if (h == last)
+				break;
+		}
+	}
+	for (h = o[0].next; h != 0 && *free_bytes < need; h = next) {
+		next = o[h].next;
+		if (!o[h].pinned)
+			evict_obj(o, h, free_bytes, res);
+	}
+}
+
+static void
+simulate(const struct sim_trace *t, int policy, uint64_t aperture,
+    struct sim_result *res)
+{
+	struct sim_obj *o;
+	uint64_t free_bytes = aperture, need, total;
+	uint32_t clock = 0, h;
+	size_t sub, i;
+
+	memset(res, 0, sizeof(*res));
+	o = calloc(t->max_handle + 1, sizeof(*o));
+	if (o == NULL)
+		err(1, "calloc");
+	for (i = 0; i < t->nents; i++)
+		o[t->ents[i].handle].size = t->ents[i].size;
+
+	for (sub = 0; sub < t->nsubs; sub++) {
+		need = total = 0;
+		for (i = t->start[sub]; i < trace_sub_end(t, sub); i++) {
+			h = t->ents[i].handle;
+			if (o[h].pinned)
+				continue;
+			o[h].pinned = true;
+			total += o[h].size;
+			if (!o[h].bound)
+				need += o[h].size;
+		}
+		if (total > aperture) {
+			res->too_big++;
+			goto unpin;
+		}
+		if (free_bytes < need)
+			evict(o, policy, need, &free_bytes, res);
+
+		/* Bind, then retire to the tail of the list in exec order. */
+		i915_evict_clock_tick(&clock);
+		for (i = t->start[sub]; i < trace_sub_end(t, sub); i++) {
+			h = t->ents[i].handle;
+			if (!o[h].pinned)
+				continue;
+			if (o[h].bound)
+				list_del_obj(o, h);
+			else
+				free_bytes -= o[h].size;
+			o[h].bound = true;
+			list_add_tail_obj(o, h);
+			i915_evict_note_use(&o[h].last_use, &o[h].reuse, clock);
+		}
+unpin:
+		for (i = t->start[sub]; i < trace_sub_end(t, sub); i++)
+			o[t->ents[i].handle].pinned = false;
+	}
+	free(o);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr,
+	    "usage: i915_evict_sim [-a aperture_mb] [-g mixed|loop|zipf] "
+	    "[-n submissions]\n"
+	    "                      [-o trace_out] [-s seed] [-t trace]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct sim_trace trace;
+	struct sim_result res, base;
+	const char *workload = "mixed", *in = NULL, *out = NULL;
+	unsigned long nsubs = 10000, seed = 1;
+	uint64_t aperture = 256ULL * 1024 * 1024;
+	int ch, policy;
+
+	while ((ch = getopt(argc, argv, "a:g:n:o:s:t:")) != -1) {
+		switch (ch) {
+		case 'a':
+			aperture = strtoull(optarg, NULL, 0) * 1024 * 1024;
+			break;
+		case 'g':
+			workload = optarg;
+			break;
+		case 'n':
+			nsubs = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			in = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (aperture == 0 || nsubs == 0)
+		usage();
+	srandom(seed);
+
+	memset(&trace, 0, sizeof(trace));
+	if (in != NULL)
+		trace_read(&trace, in);
+	else
+		trace_generate(&trace, workload, nsubs, aperture);
+	if (out != NULL)
+		trace_write(&trace, out);
+	if (trace.nsubs == 0)
+		errx(1, "no submissions");
+
+	printf("%s, %zu submissions, %zu objects bound, %" PRIu64
+	    " MB aperture\n", in != NULL ? in : workload, trace.nsubs,
+	    trace.nents, aperture / (1024 * 1024));
+	memset(&base, 0, sizeof(base));
+	for (policy = 0; policy < I915_EVICT_NPOLICY; policy++) {
+		simulate(&trace, policy, aperture, &res);
+		if (policy == I915_EVICT_LIST)
+			base = res;
+		printf("%-8s %10.1f KB/submission %10" PRIu64 " evictions"
+		    "  x%.2f", policy_names[policy],
+		    (double)res.evicted_bytes / 1024 / trace.nsubs,
+		    res.evictions, res.evicted_bytes != 0 ?
+		    (double)base.evicted_bytes / res.evicted_bytes : 0.0);
+		if (res.too_big != 0)
+			printf("  (%" PRIu64 " submissions larger than the "
+			    "aperture skipped)", res.too_big);
+		printf("\n");
+	}
+	return (0);
+}
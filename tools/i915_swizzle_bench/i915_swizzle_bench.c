@@ -0,0 +1,187 @@
+/*-
+ * Userspace test and benchmark for the bit 17 page swizzle kernels.
+ *
+ * Every implementation of i915_swizzle.h the CPU supports is first checked
+ * against a byte-by-byte reference of the o ^ 64 mapping, then timed
+ * swapping the halves of whole pages in place, as on bind or unbind.
+ */
+
+#include <sys/param.h>
+
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef PAGE_SIZE
+#define	PAGE_SIZE	4096
+#endif
+#ifndef nitems
+#define	nitems(x)	(sizeof((x)) / sizeof((x)[0]))
+#endif
+
+#include "i915_swizzle.h"
+
+static const char *impl_names[] = { "scalar", "sse2", "avx" };
+
+static bool
+impl_supported(int impl)
+{
+
+	switch (impl) {
+	case I915_SWIZZLE_SCALAR:
+		return (true);
+#ifdef __x86_64__
+	case I915_SWIZZLE_SSE2:
+		return (__builtin_cpu_supports("sse2"));
+	case I915_SWIZZLE_AVX:
+		return (__builtin_cpu_supports("avx"));
+#endif
+	default:
+		return (false);
+	}
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static char *
+alloc_pages(size_t npages)
+{
+	void *p;
+
+	if (posix_memalign(&p, PAGE_SIZE, npages * PAGE_SIZE) != 0)
+		err(1, "posix_memalign");
+	return (p);
+}
+
+static void
+fill_random(char *p, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		p[i] = random();
+}
+
+static int
+check_impl(int impl)
+{
+	char *page, *ref, *out;
+	int errors = 0, k;
+
+	page = alloc_pages(1);
+	ref = alloc_pages(1);
+	out = alloc_pages(1);
+
+	/* Page swizzle, and swizzling twice is the identity. */
+	fill_random(page, PAGE_SIZE);
+	for (k = 0; k < PAGE_SIZE; k++)
+		ref[k] = page[k ^ 64];
+	memcpy(out, page, PAGE_SIZE);
+	i915_swizzle_page_impl(impl, page);
+	if (memcmp(page, ref, PAGE_SIZE) != 0) {
+		printf("%s: page swizzle mismatch\n", impl_names[impl]);
+		errors++;
+	}
+	i915_swizzle_page_impl(impl, page);
+	if (memcmp(page, out, PAGE_SIZE) != 0) {
+		printf("%s: double page swizzle is not the identity\n",
+		    impl_names[impl]);
+		errors++;
+	}
+
+	free(page);
+	free(ref);
+	free(out);
+	return (errors);
+}
+
+static double
+bench(int impl, size_t npages, unsigned iterations)
+{
+	char *pages;
+	uint64_t t0, elapsed;
+	size_t p;
+	unsigned it;
+
+	pages = alloc_pages(npages);
+	fill_random(pages, npages * PAGE_SIZE);
+
+	t0 = now_ns();
+	for (it = 0; it < iterations; it++) {
+		for (p = 0; p < npages; p++)
+			i915_swizzle_page_impl(impl, pages + p * PAGE_SIZE);
+	}
+	elapsed = now_ns() - t0;
+
+	free(pages);
+	return (elapsed != 0 ? (double)npages * PAGE_SIZE * iterations /
+	    elapsed : 0.0);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr,
+	    "usage: i915_swizzle_bench [-i iterations] [-n pages] "
+	    "[-s seed]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	double gbs, base = 0.0;
+	unsigned long npages = 256, seed = 1;
+	unsigned iterations = 200;
+	int ch, errors = 0, impl;
+
+	while ((ch = getopt(argc, argv, "i:n:s:")) != -1) {
+		switch (ch) {
+		case 'i':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			npages = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (npages == 0 || iterations == 0)
+		usage();
+	srandom(seed);
+
+	for (impl = 0; impl < I915_SWIZZLE_NIMPL; impl++) {
+		if (!impl_supported(impl)) {
+			printf("%-8s not supported by this CPU\n",
+			    impl_names[impl]);
+			continue;
+		}
+		errors += check_impl(impl);
+		gbs = bench(impl, npages, iterations);
+		if (impl == I915_SWIZZLE_SCALAR)
+			base = gbs;
+		printf("%-8s %7.2f GB/s  x%.2f\n", impl_names[impl], gbs,
+		    base != 0 ? gbs / base : 0.0);
+	}
+	if (errors != 0)
+		errx(1, "%d mismatches", errors);
+	printf("all implementations match the reference\n");
+	return (0);
+}
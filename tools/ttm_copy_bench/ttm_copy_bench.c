@@ -0,0 +1,313 @@
+/*-
+ * Userspace benchmark for the ttm_bo_move_memcpy() copy kernels.
+ *
+ * The "io" regions of a move are plain memory here, one contiguous buffer
+ * per placement, and the ttm side is an array of separately allocated
+ * pages, so the numbers show the cost of the kernels and of the split
+ * rather than of a particular device's BAR.  Each path is timed:
+ *
+ *	io-io	VRAM to VRAM, both mapped contiguously
+ *	io-ttm	VRAM to system pages, as on eviction
+ *	ttm-io	system pages to VRAM
+ *
+ * with the old 32-bit loop ("io32") as the baseline, then each kernel of
+ * ttm_copy.h the CPU supports.  -t splits every move across that many
+ * threads besides the caller, as hw.drm.ttm_copy.threads does.  Every copy
+ * is checked against its source.
+ */
+
+#include <sys/param.h>
+
+#include <err.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef PAGE_SIZE
+#define	PAGE_SIZE	4096
+#endif
+#ifndef nitems
+#define	nitems(x)	(sizeof((x)) / sizeof((x)[0]))
+#endif
+
+#include "ttm_copy.h"
+
+#define	IMPL_IO32	(-1)
+
+static const char *impl_names[] = { "scalar", "sse2", "sse41" };
+
+enum path { IO_IO, IO_TTM, TTM_IO };
+static const char *path_names[] = { "io-io", "io-ttm", "ttm-io" };
+
+struct move {
+	enum path path;
+	int impl;
+	char *io_src;
+	char *io_dst;
+	char **ttm;
+};
+
+struct chunk {
+	pthread_t thread;
+	struct move *m;
+	size_t first;
+	size_t count;
+};
+
+static bool
+impl_supported(int impl)
+{
+
+	switch (impl) {
+	case IMPL_IO32:
+	case TTM_COPY_SCALAR:
+		return (true);
+#ifdef __x86_64__
+	case TTM_COPY_SSE2:
+		return (__builtin_cpu_supports("sse2"));
+	case TTM_COPY_SSE41:
+		return (__builtin_cpu_supports("sse4.1"));
+#endif
+	default:
+		return (false);
+	}
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static char *
+alloc_pages(size_t npages)
+{
+	void *p;
+
+	if (posix_memalign(&p, PAGE_SIZE, npages * PAGE_SIZE) != 0)
+		err(1, "posix_memalign");
+	return (p);
+}
+
+/* The loop ttm_copy_io_page() used before the kernels. */
+static void
+copy_io32(void *dst, const void *src)
+{
+	volatile uint32_t *d = dst;
+	const volatile uint32_t *s = src;
+	int i;
+
+	for (i = 0; i < PAGE_SIZE / (int)sizeof(uint32_t); i++)
+		*d++ = *s++;
+}
+
+static void
+copy_page(int impl, void *dst, const void *src)
+{
+
+	if (impl == IMPL_IO32)
+		copy_io32(dst, src);
+	else
+		ttm_copy_page_impl(impl, dst, src);
+}
+
+static void
+move_pages(struct move *m, size_t first, size_t count)
+{
+	size_t page;
+
+	for (page = first; page < first + count; page++) {
+		switch (m->path) {
+		case IO_IO:
+			copy_page(m->impl, m->io_dst + page * PAGE_SIZE,
+			    m->io_src + page * PAGE_SIZE);
+			break;
+		case IO_TTM:
+			copy_page(m->impl, m->ttm[page],
+			    m->io_src + page * PAGE_SIZE);
+			break;
+		case TTM_IO:
+			copy_page(m->impl, m->io_dst + page * PAGE_SIZE,
+			    m->ttm[page]);
+			break;
+		}
+	}
+}
+
+static void *
+chunk_thread(void *arg)
+{
+	struct chunk *c = arg;
+
+	move_pages(c->m, c->first, c->count);
+	return (NULL);
+}
+
+/* Split like ttm_copy_pages_split(): the caller copies the first chunk. */
+static void
+move(struct move *m, size_t npages, int nthreads)
+{
+	struct chunk chunks[64];
+	size_t per, first;
+	int i, n;
+
+	if (nthreads == 0) {
+		move_pages(m, 0, npages);
+		return;
+	}
+	per = howmany(npages, nthreads + 1);
+	for (n = 0, first = per; n < nthreads && first < npages;
+	    n++, first += per) {
+		chunks[n].m = m;
+		chunks[n].first = first;
+		chunks[n].count = MIN(per, npages - first);
+		if (pthread_create(&chunks[n].thread, NULL, chunk_thread,
+		    &chunks[n]) != 0)
+			errx(1, "pthread_create");
+	}
+	move_pages(m, 0, MIN(per, npages));
+	for (i = 0; i < n; i++)
+		pthread_join(chunks[i].thread, NULL);
+}
+
+static int
+check(struct move *m, size_t npages)
+{
+	size_t page;
+	const char *src, *dst;
+
+	for (page = 0; page < npages; page++) {
+		switch (m->path) {
+		case IO_IO:
+			src = m->io_src + page * PAGE_SIZE;
+			dst = m->io_dst + page * PAGE_SIZE;
+			break;
+		case IO_TTM:
+			src = m->io_src + page * PAGE_SIZE;
+			dst = m->ttm[page];
+			break;
+		default:
+			src = m->ttm[page];
+			dst = m->io_dst + page * PAGE_SIZE;
+			break;
+		}
+		if (memcmp(src, dst, PAGE_SIZE) != 0)
+			return (1);
+	}
+	return (0);
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr,
+	    "usage: ttm_copy_bench [-i iterations] [-n pages] [-t threads]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct move m;
+	double gbs, base[nitems(path_names)];
+	unsigned long npages = 16384;
+	unsigned iterations = 10, it;
+	uint64_t t0, elapsed;
+	size_t i, p;
+	int ch, errors = 0, impl, nthreads = 0;
+	char *io_a, *io_b, *ttm_pool;
+
+	while ((ch = getopt(argc, argv, "i:n:t:")) != -1) {
+		switch (ch) {
+		case 'i':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			npages = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nthreads = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (npages == 0 || iterations == 0 || nthreads < 0 || nthreads > 64)
+		usage();
+
+	io_a = alloc_pages(npages);
+	io_b = alloc_pages(npages);
+	/* Scatter the ttm pages, a page apart, as system pages would be. */
+	ttm_pool = alloc_pages(npages * 2);
+	m.ttm = calloc(npages, sizeof(*m.ttm));
+	if (m.ttm == NULL)
+		err(1, "calloc");
+	for (p = 0; p < npages; p++)
+		m.ttm[p] = ttm_pool + ((p * 7919) % (npages * 2)) * PAGE_SIZE;
+	if ((npages * 2) % 7919 == 0)
+		for (p = 0; p < npages; p++)
+			m.ttm[p] = ttm_pool + p * 2 * PAGE_SIZE;
+	for (i = 0; i < npages * PAGE_SIZE; i++)
+		io_a[i] = random();
+	memset(io_b, 0, npages * PAGE_SIZE);
+	memset(ttm_pool, 0, npages * 2 * PAGE_SIZE);
+
+	printf("%lu pages, %d threads besides the caller\n", npages, nthreads);
+	for (impl = IMPL_IO32; impl < TTM_COPY_NIMPL; impl++) {
+		const char *name = impl == IMPL_IO32 ? "io32" :
+		    impl_names[impl];
+
+		if (!impl_supported(impl)) {
+			printf("%-8s not supported by this CPU\n", name);
+			continue;
+		}
+		for (i = 0; i < nitems(path_names); i++) {
+			m.path = i;
+			m.impl = impl;
+			m.io_src = io_a;
+			m.io_dst = io_b;
+
+			/* Fill the ttm pages first for the ttm-io path. */
+			if (m.path == TTM_IO) {
+				struct move fill = m;
+
+				fill.path = IO_TTM;
+				fill.impl = TTM_COPY_SCALAR;
+				move_pages(&fill, 0, npages);
+				memset(io_b, 0, npages * PAGE_SIZE);
+			}
+
+			t0 = now_ns();
+			for (it = 0; it < iterations; it++)
+				move(&m, npages, nthreads);
+			elapsed = now_ns() - t0;
+
+			if (check(&m, npages) != 0) {
+				printf("%-8s %-6s copy mismatch\n", name,
+				    path_names[i]);
+				errors++;
+			}
+			gbs = elapsed != 0 ? (double)npages * PAGE_SIZE *
+			    iterations / elapsed : 0.0;
+			if (impl == IMPL_IO32)
+				base[i] = gbs;
+			printf("%-8s %-6s %7.2f GB/s  x%.2f\n", name,
+			    path_names[i], gbs, base[i] != 0 ? gbs / base[i] :
+			    0.0);
+			memset(io_b, 0, npages * PAGE_SIZE);
+		}
+	}
+	if (errors != 0)
+		errx(1, "%d mismatches", errors);
+	printf("all copies match their source\n");
+	return (0);
+}